@@ -11,6 +11,7 @@
 #include "global.h"
 #include "timer.h"
 #include "string.h"
+#include "softirq.h"
 
 /* 定义硬盘各寄存器的端口号 */
 #define reg_data(channel)   (channel->port_base + 0)
@@ -50,6 +51,7 @@ struct ide_channel channels[2];     //有两个ide通道
 int32_t ext_lba_base = 0;
 uint8_t p_no = 0, l_no = 0;     //用来记录硬盘主分区和逻辑分区的下标
 struct list partition_list;     //分区队列
+struct rwlock partition_lock;   //保护partition_list，遍历时持读锁
 
 /* 构建一个16字节大小的结构体，用来存分区表项 */
 struct partition_table_entry{
@@ -132,8 +134,8 @@ static void write2sector(struct disk* hd, void* buf, uint8_t sec_cnt){
 /* 等待30秒 */
 static bool busy_wait(struct disk* hd){
   struct ide_channel* channel = hd->my_channel;
-  uint16_t time_limit = 30 * 1000;
-  while(time_limit -= 10 >= 0){
+  int32_t time_limit = 30 * 1000;
+  while((time_limit -= 10) >= 0){
     if(!(inb(reg_status(channel))& BIT_STAT_BSY)){      //如果bsy为0就表示不忙
       return (inb(reg_status(channel)) & BIT_STAT_DRQ);     //DRQ为1表示硬盘已经准备好了数据
     }else{
@@ -257,6 +259,12 @@ void ide_write(struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt){
  
 }
 
+/* 硬盘tasklet，唤醒等待本通道读写完成的线程 */
+static void hd_done_tasklet(void* arg){
+  struct ide_channel* channel = arg;
+  sema_up(&channel->disk_done);
+}
+
 /* 硬盘中断程序 */
 static void intr_hd_handler(uint8_t irq_no){
   ASSERT(irq_no == 0x2e || irq_no == 0x2f);
@@ -265,9 +273,10 @@ static void intr_hd_handler(uint8_t irq_no){
   ASSERT(channel->irq_no == irq_no);
   if(channel->expection_intr){      //这里若判断为true，则说明是我们自己设置的，是需要处理的中断
     channel->expection_intr = false;
-    sema_up(&channel->disk_done);
     /* 读取状态寄存器使得硬盘控制器认为此次的中断已被处理，从而硬盘可以继续执行新的读写 */
     inb(reg_status(channel));
+    /* 唤醒驱动程序留到中断返回时开中断进行 */
+    tasklet_schedule(&channel->done_tasklet);
   }
 }
 
@@ -333,7 +342,9 @@ static void partition_scan(struct disk* hd, uint32_t ext_lba){
         hd->prim_parts[p_no].start_lba = ext_lba + p->start_lba;
         hd->prim_parts[p_no].sec_cnt = p->sec_cnt;
         hd->prim_parts[p_no].my_disk = hd;
+        write_lock(&partition_lock);
         list_append(&partition_list, &hd->prim_parts[p_no].part_tag);
+        write_unlock(&partition_lock);
         sprintf(hd->prim_parts[p_no].name, "%s%d", hd->name, p_no + 1);
         p_no++;
         ASSERT(p_no < 4);
@@ -341,7 +352,9 @@ static void partition_scan(struct disk* hd, uint32_t ext_lba){
         hd->logic_parts[l_no].start_lba = ext_lba + p->start_lba;
         hd->logic_parts[l_no].sec_cnt = p->sec_cnt;
         hd->logic_parts[l_no].my_disk = hd;
+        write_lock(&partition_lock);
         list_append(&partition_list, &hd->logic_parts[l_no].part_tag);
+        write_unlock(&partition_lock);
         sprintf(hd->logic_parts[l_no].name, "%s%d", hd->name, l_no + 5);
         l_no++;
         if(l_no >= 8){  //咱们这里限制了只支持8个
@@ -368,6 +381,7 @@ void ide_init(){
   uint8_t hd_cnt = *((uint8_t*)(0x475));    //获取硬盘数量，这里的地址是固定的
   ASSERT(hd_cnt > 0);
   list_init(&partition_list);
+  rwlock_init(&partition_lock);
   channel_cnt = DIV_ROUND_UP(hd_cnt, 2);    //一个通道有两个硬盘，这里我们通过硬盘数量反推通道数
   struct ide_channel* channel;
   uint8_t channel_no=0, dev_no = 0;
@@ -393,6 +407,7 @@ void ide_init(){
      * 因盘驱动sema_down此信号会阻塞线程，
      * 直到硬盘完成后通过发中断，由中断处理程序将此信号sema_up，唤醒线程*/
     sema_init(&channel->disk_done, 0);
+    tasklet_init(&channel->done_tasklet, hd_done_tasklet, channel);
     register_handler(channel->irq_no, intr_hd_handler);
     
     /* 分别获取两个个硬盘的参数及分区信息 */
@@ -413,6 +428,8 @@ void ide_init(){
   }
   printk("\n    all partition info\n");
   /* 打印所有分区信息 */
+  read_lock(&partition_lock);
   list_traversal(&partition_list, partition_info, (int)NULL);
+  read_unlock(&partition_lock);
   printk("ide_init_done\n");
 }
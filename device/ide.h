@@ -4,6 +4,7 @@
 #include "list.h"
 #include "bitmap.h"
 #include "sync.h"
+#include "softirq.h"
 
 /* 分区结构 */
 struct partition {
@@ -35,6 +36,7 @@ struct ide_channel{
   struct lock lock;             //通道锁
   bool expection_intr;          //表示等待硬盘的中断
   struct semaphore disk_done;   //用于阻塞、唤醒驱动程序
+  struct tasklet done_tasklet;  //中断返回时唤醒驱动程序
   struct disk devices[2];       //一个通道上的主从两个硬盘
 };
 
@@ -42,6 +44,7 @@ struct ide_channel{
 extern uint8_t channel_cnt;    //通道数
 extern struct ide_channel channels[2];  //两个通道
 extern struct list partition_list;    //分区队列
+extern struct rwlock partition_lock;  //保护partition_list，遍历时持读锁
 
 void ide_init(void);
 void ide_read(struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt);
@@ -2,10 +2,11 @@
 #include "interrupt.h"
 #include "global.h"
 #include "debug.h"
+#include "spinlock.h"
 
 /* 初始化io队列ioq */
 void ioqueue_init(struct ioqueue* ioq){
-  lock_init(&ioq->lock);    //初始化ioq的锁
+  spin_lock_init(&ioq->lock);    //初始化ioq的锁
   ioq->producer = ioq->consumer = NULL;     //生产者消费者置空
   ioq->head = ioq->tail = 0;    //队列的首尾地址指向缓冲区数组第0个位置
 }
@@ -15,69 +16,90 @@ static int32_t next_pos(int32_t pos){
   return (pos + 1)% bufsize;
 }
 
+/* 以下两个函数须持有ioq->lock */
+static bool full(struct ioqueue* ioq){
+  return next_pos(ioq->head) == ioq->tail;
+}
+
+static bool empty(struct ioqueue* ioq){
+  return ioq->head == ioq->tail;
+}
+
 /* 判断队列是否已满 */
 bool ioq_full(struct ioqueue* ioq){
-  ASSERT(intr_get_status() == INTR_OFF);
-  return next_pos(ioq->head) == ioq->tail;
+  enum intr_status old_status = spin_lock_irqsave(&ioq->lock);
+  bool ret = full(ioq);
+  spin_unlock_irqrestore(&ioq->lock, old_status);
+  return ret;
 }
 
 /* 判断队列是否以空 */
 /* 返回true，表示队列为空 */
 bool ioq_empty(struct ioqueue* ioq){
-  ASSERT(intr_get_status() == INTR_OFF);
-  return ioq->head == ioq->tail;
+  enum intr_status old_status = spin_lock_irqsave(&ioq->lock);
+  bool ret = empty(ioq);
+  spin_unlock_irqrestore(&ioq->lock, old_status);
+  return ret;
 }
 
-/* 使当前生产者或消费者在缓冲区上等待 */
-static void ioq_wait(struct task_struct** waiter){
-  ASSERT(*waiter == NULL && waiter != NULL);
-  *waiter = running_thread();
-  thread_block(TASK_BLOCKED);
+/* 使当前生产者或消费者在缓冲区上等待，须持有ioq->lock，返回时仍持有。
+ * 每一侧只记录一个等待者，已有其他线程在等待时让出CPU后重试 */
+static void ioq_wait(struct ioqueue* ioq, struct task_struct** waiter){
+  if(*waiter != NULL){
+    spin_unlock(&ioq->lock);
+    thread_yield();
+  }else{
+    *waiter = running_thread();
+    thread_block_unlock(TASK_BLOCKED, &ioq->lock);
+  }
+  spin_lock(&ioq->lock);
 }
 
-/* 唤醒waiter */
-static void wakeup(struct task_struct** waiter){
-  ASSERT(*waiter != NULL);
-  thread_unblock(*waiter);
+/* 取下waiter，返回需要唤醒的线程，唤醒在释放ioq->lock之后进行 */
+static struct task_struct* take_waiter(struct task_struct** waiter){
+  struct task_struct* pthread = *waiter;
   *waiter = NULL;
+  return pthread;
 }
 
 /* 消费者从ioq队列中获取一个字符*/
 char ioq_getchar(struct ioqueue* ioq){
-  ASSERT(intr_get_status() == INTR_OFF);
+  enum intr_status old_status = spin_lock_irqsave(&ioq->lock);
   /* 若缓冲区为空，把消费者ioq->consumer记为当前线程自己
    * 目的是将来生产者往缓冲区里面装商品的时候，生产者知道唤醒哪个消费者
-   * 也就是幻想当前线程自己 */
-  while(ioq_empty(ioq)){
-    lock_acquire(&ioq->lock);
-    ioq_wait(&ioq->consumer);
-    lock_release(&ioq->lock);
+   * 也就是唤醒当前线程自己 */
+  while(empty(ioq)){
+    ioq_wait(ioq, &ioq->consumer);
   }
 
   char byte = ioq->buf[ioq->tail];      //从缓冲区取得一个字符
   ioq->tail = next_pos(ioq->tail);      //把读游标移到下一个位置
 
-  if(ioq->producer != NULL){
-    wakeup(&ioq->producer);             //唤醒生产者
+  struct task_struct* producer = take_waiter(&ioq->producer);
+  spin_unlock(&ioq->lock);
+  if(producer != NULL){
+    thread_unblock(producer);           //唤醒生产者
   }
+  intr_set_status(old_status);
   return byte;
 }
 
-/* 生产者从ioq队列中写入一个字符 */
+/* 生产者从ioq队列中写入一个字符，中断处理程序中调用时须先确认队列不满 */
 void ioq_putchar(struct ioqueue* ioq, char byte){
-  ASSERT(intr_get_status() == INTR_OFF);
+  enum intr_status old_status = spin_lock_irqsave(&ioq->lock);
   /* 若缓冲区为满，把生产者ioq->producer记为自己，
    * 目的和是当缓冲区里面的东西被消费者取完后让消费者知道唤醒哪个生产者，
    * 也就是唤醒自己 */
-  while(ioq_full(ioq)){
-    lock_acquire(&ioq->lock);
-    ioq_wait(&ioq->producer);
-    lock_release(&ioq->lock);
+  while(full(ioq)){
+    ioq_wait(ioq, &ioq->producer);
   }
   ioq->buf[ioq->head] = byte;           //把字节放入缓冲区中
   ioq->head = next_pos(ioq->head);      //把写游标移到下一个位置
 
-  if(ioq->consumer != NULL){
-    wakeup(&ioq->consumer);             //唤醒消费者
+  struct task_struct* consumer = take_waiter(&ioq->consumer);
+  spin_unlock(&ioq->lock);
+  if(consumer != NULL){
+    thread_unblock(consumer);           //唤醒消费者
   }
-}
\ No newline at end of file
+  intr_set_status(old_status);
+}
@@ -2,14 +2,14 @@
 #define __DEVICE_IOQUEUE_H
 #include "stdint.h"
 #include "thread.h"
-#include "sync.h"
+#include "spinlock.h"
 
 #define bufsize 64
 
 /* 环形队列 */
 struct ioqueue{
   //生产者消费者
-  struct lock lock;     //本缓冲区的锁
+  struct spinlock lock; //保护下面各项，可在中断处理程序中获取
   /* 生产者，缓冲区不满的时候就继续往里面放数据
    * 否则就睡眠，此项记录哪个生产者在此缓冲区上睡眠 */
   struct task_struct* producer;
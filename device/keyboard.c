@@ -5,7 +5,9 @@
 #include "global.h"
 #include "stdint.h"
 #include "ioqueue.h"
+#include "softirq.h"
 #define KBD_BUF_PORT 0x60
+#define SCANCODE_BUF_SIZE 64    //中断中读到、尚未被tasklet解码的扫描码个数上限
 
 /* 用转义字符定义一部分控制字符 */
 #define esc '\x1b'      //十六进制表示
@@ -41,6 +43,12 @@ struct ioqueue kbd_buf;     //定义键盘缓冲区
  * ext_scancode用于记录makecode是否以0xe0开头 */
 static bool ctrl_status, shift_status, alt_status, caps_lock_status, ext_scancode;
 
+/* 中断处理程序只把扫描码放入此环形缓冲区，由tasklet解码，
+ * 两者都在BSP上，中断是唯一的生产者，tasklet是唯一的消费者 */
+static uint8_t scancode_buf[SCANCODE_BUF_SIZE];
+static volatile uint32_t scancode_head, scancode_tail;
+static struct tasklet kbd_tasklet;
+
 /* 以通码make_code为索引的二维数组 */
 static char keymap[][2] = {
   /* 扫描码未与shift组合 */
@@ -107,15 +115,14 @@ static char keymap[][2] = {
   /* 其他按键暂不处理 */
 };
 
-/* 键盘中断处理程序 */
-static void intr_keyboard_handler(void){
+/* 解码一个扫描码，得到的字符放入键盘缓冲区 */
+static void scancode_decode(uint16_t scancode){
   /* 这次中断发生前的上一次中断，以下任意三个键是否有人按下 */
   //bool ctrl_down_last = ctrl_status;
   bool shift_down_last = shift_status;
   bool caps_lock_last = caps_lock_status;
 
   bool break_code;
-  uint16_t scancode = inb(KBD_BUF_PORT);
 
   /* 若扫描码scancode是e0开头的，表示此键的按下将产生多个扫描码，
    * 所以马上结束此中断处理函数，等待下一个扫描码进入*/
@@ -204,10 +211,32 @@ static void intr_keyboard_handler(void){
   }
 }
 
+/* 键盘tasklet，解码中断处理程序积攒下来的扫描码 */
+static void kbd_tasklet_func(void* arg UNUSED){
+  while(scancode_tail != scancode_head){
+    uint8_t scancode = scancode_buf[scancode_tail];
+    scancode_tail = (scancode_tail + 1) % SCANCODE_BUF_SIZE;
+    scancode_decode(scancode);
+  }
+}
+
+/* 键盘中断处理程序，读出扫描码以便键盘控制器继续工作，解码留给tasklet */
+static void intr_keyboard_handler(void){
+  uint8_t scancode = inb(KBD_BUF_PORT);
+  uint32_t next = (scancode_head + 1) % SCANCODE_BUF_SIZE;
+  if(next != scancode_tail){    //缓冲区满时丢弃
+    scancode_buf[scancode_head] = scancode;
+    scancode_head = next;
+  }
+  tasklet_schedule(&kbd_tasklet);
+}
+
 /* 键盘初始化 */
 void keyboard_init(){
   put_str("keyboard init start \n");
   ioqueue_init(&kbd_buf);
+  scancode_head = scancode_tail = 0;
+  tasklet_init(&kbd_tasklet, kbd_tasklet_func, NULL);
   register_handler(0x21, intr_keyboard_handler);
   put_str("keyboard init done \n");
 }
\ No newline at end of file
@@ -0,0 +1,180 @@
+#include "lapic.h"
+#include "stdint.h"
+#include "global.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "timer.h"
+#include "spinlock.h"
+#include "print.h"
+
+#define LAPIC_PADDR     0xfee00000      //本地APIC寄存器的物理地址
+#define LAPIC_VADDR     0xfee00000      //恒等映射到内核空间的同一地址
+
+/* 本地APIC寄存器偏移 */
+#define LAPIC_ID        0x20
+#define LAPIC_TPR       0x80            //任务优先级
+#define LAPIC_EOI       0xb0
+#define LAPIC_SVR       0xf0            //伪中断向量，兼作APIC的软件使能
+#define LAPIC_ESR       0x280           //错误状态
+#define LAPIC_ICR_LOW   0x300           //中断命令寄存器，写低32位时发出IPI
+#define LAPIC_ICR_HIGH  0x310
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_LVT_LINT0 0x350
+#define LAPIC_LVT_LINT1 0x360
+#define LAPIC_LVT_ERROR 0x370
+#define LAPIC_TIMER_INIT 0x380          //定时器初始计数
+#define LAPIC_TIMER_CUR 0x390           //定时器当前计数
+#define LAPIC_TIMER_DIV 0x3e0           //定时器分频
+
+#define SVR_ENABLE      0x100
+#define LVT_MASKED      0x10000
+#define LVT_PERIODIC    0x20000
+#define LVT_EXTINT      0x700
+#define LVT_NMI         0x400
+#define TIMER_DIV_16    0x3
+#define ICR_INIT        0x500
+#define ICR_STARTUP     0x600
+#define ICR_ASSERT      0x4000
+#define ICR_PENDING     0x1000          //IPI尚未送出
+#define ICR_ALL_BUT_SELF 0xc0000        //广播给除自己外的所有CPU
+
+#define CALIBRATE_TICKS 5               //用PIT校准本地定时器时测量的tick数
+
+static uint32_t lapic_timer_count;      //本地定时器每个tick的计数值
+
+/* 读本地APIC寄存器 */
+static uint32_t lapic_read(uint32_t reg){
+  return *(volatile uint32_t*)(LAPIC_VADDR + reg);
+}
+
+/* 写本地APIC寄存器，回读一次ID寄存器确保写操作已完成 */
+static void lapic_write(uint32_t reg, uint32_t val){
+  *(volatile uint32_t*)(LAPIC_VADDR + reg) = val;
+  lapic_read(LAPIC_ID);
+}
+
+/* 等待上一个IPI送出 */
+static void icr_wait(void){
+  while(lapic_read(LAPIC_ICR_LOW) & ICR_PENDING){
+    cpu_relax();
+  }
+}
+
+/* 忙等n个tick，调用者需开中断 */
+static void ticks_spin(uint32_t n){
+  volatile uint32_t* now = &ticks;
+  uint32_t start = *now;
+  while(*now - start < n){
+    cpu_relax();
+  }
+}
+
+/* 伪中断无需处理，也不能发送EOI */
+static void intr_spurious_handler(void){
+}
+
+/* 软件使能本地APIC，清除错误状态，接收所有优先级的中断 */
+static void lapic_enable(void){
+  lapic_write(LAPIC_SVR, SVR_ENABLE | SPURIOUS_VECTOR);
+  lapic_write(LAPIC_LVT_ERROR, LVT_MASKED);
+  lapic_write(LAPIC_ESR, 0);
+  lapic_write(LAPIC_ESR, 0);
+  lapic_write(LAPIC_TPR, 0);
+}
+
+/* 用PIT的ticks校准本地定时器的频率 */
+static void lapic_timer_calibrate(void){
+  enum intr_status old_status = intr_enable();
+  lapic_write(LAPIC_TIMER_DIV, TIMER_DIV_16);
+  lapic_write(LAPIC_LVT_TIMER, LVT_MASKED);
+  ticks_spin(1);        //先对齐到tick的边界
+  lapic_write(LAPIC_TIMER_INIT, 0xffffffff);
+  ticks_spin(CALIBRATE_TICKS);
+  lapic_timer_count = (0xffffffff - lapic_read(LAPIC_TIMER_CUR)) / CALIBRATE_TICKS;
+  lapic_write(LAPIC_TIMER_INIT, 0);
+  intr_set_status(old_status);
+}
+
+/* 通过cpuid判断处理器是否有本地APIC */
+bool lapic_present(void){
+  uint32_t eax = 1, ebx, ecx = 0, edx;
+  asm volatile ("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+  return (edx >> 9) & 1;
+}
+
+/* BSP初始化本地APIC，8259A的中断仍经由LINT0送到BSP，PIT继续作为BSP的时钟 */
+void lapic_init(void){
+  put_str("lapic_init start\n");
+  mmio_map(LAPIC_VADDR, LAPIC_PADDR);
+  lapic_enable();
+  lapic_write(LAPIC_LVT_LINT0, LVT_EXTINT);
+  lapic_write(LAPIC_LVT_LINT1, LVT_NMI);
+  register_handler(SPURIOUS_VECTOR, intr_spurious_handler);
+  lapic_timer_calibrate();
+  put_str("lapic_init done\n");
+}
+
+/* AP初始化本地APIC，屏蔽外部中断，启动周期性的本地定时器作为时钟 */
+void lapic_ap_init(void){
+  lapic_enable();
+  lapic_write(LAPIC_LVT_LINT0, LVT_MASKED);
+  lapic_write(LAPIC_LVT_LINT1, LVT_MASKED);
+  lapic_write(LAPIC_TIMER_DIV, TIMER_DIV_16);
+  lapic_write(LAPIC_LVT_TIMER, LVT_PERIODIC | LAPIC_TIMER_VECTOR);
+  lapic_write(LAPIC_TIMER_INIT, lapic_timer_count);
+}
+
+/* AP空闲时把本地定时器改为n个tick后触发一次，n超过32位计数所能表示的范围时取上限 */
+void lapic_timer_oneshot(uint32_t n){
+  uint32_t max = 0xffffffff / lapic_timer_count;
+  if(n > max){
+    n = max;
+  }
+  lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_VECTOR);
+  lapic_write(LAPIC_TIMER_INIT, n * lapic_timer_count);
+}
+
+/* 恢复周期模式，返回单次触发期间经过的、尚未由时钟中断计入的整tick数。
+ * 到期后当前计数停在0，到期的那次中断已经或即将计入1个tick */
+uint32_t lapic_timer_periodic(void){
+  uint32_t init = lapic_read(LAPIC_TIMER_INIT);
+  uint32_t cur = lapic_read(LAPIC_TIMER_CUR);
+  uint32_t elapsed = (init - cur) / lapic_timer_count;
+  if(cur == 0 && elapsed > 0){
+    elapsed--;
+  }
+  lapic_write(LAPIC_LVT_TIMER, LVT_PERIODIC | LAPIC_TIMER_VECTOR);
+  lapic_write(LAPIC_TIMER_INIT, lapic_timer_count);
+  return elapsed;
+}
+
+/* 返回本CPU的APIC ID */
+uint8_t lapic_id(void){
+  return lapic_read(LAPIC_ID) >> 24;
+}
+
+/* 本地APIC中断的结束命令 */
+void lapic_eoi(void){
+  lapic_write(LAPIC_EOI, 0);
+}
+
+/* 向apic_id指定的CPU发送vector号中断 */
+void lapic_send_ipi(uint8_t apic_id, uint8_t vector){
+  icr_wait();
+  lapic_write(LAPIC_ICR_HIGH, (uint32_t)apic_id << 24);
+  lapic_write(LAPIC_ICR_LOW, ICR_ASSERT | vector);
+}
+
+/* 按INIT-SIPI-SIPI的顺序唤醒所有AP，让它们从entry_paddr处以实模式开始执行，
+ * entry_paddr须4K对齐且位于低端1MB内，调用者需开中断以便用ticks计时 */
+void lapic_startup_aps(uint32_t entry_paddr){
+  icr_wait();
+  lapic_write(LAPIC_ICR_LOW, ICR_ALL_BUT_SELF | ICR_ASSERT | ICR_INIT);
+  ticks_spin(2);        //INIT后至少等待10毫秒
+  uint32_t sipi;
+  for(sipi = 0; sipi < 2; sipi++){
+    icr_wait();
+    lapic_write(LAPIC_ICR_LOW, ICR_ALL_BUT_SELF | ICR_ASSERT | ICR_STARTUP | (entry_paddr >> 12));
+    ticks_spin(2);      //两次SIPI间至少等待200微秒
+  }
+}
@@ -0,0 +1,21 @@
+#ifndef __DEVICE_LAPIC_H
+#define __DEVICE_LAPIC_H
+#include "stdint.h"
+#include "global.h"
+
+/* 本地APIC使用的中断向量，排在8259A的0x20~0x2f之后 */
+#define LAPIC_TIMER_VECTOR 0x30     //AP的本地时钟中断
+#define RESCHED_VECTOR 0x31         //唤醒idle的CPU去重新调度
+#define TLB_FLUSH_VECTOR 0x32       //要求其他CPU刷新TLB
+#define SPURIOUS_VECTOR 0x3f        //伪中断，无需EOI
+
+bool lapic_present(void);
+void lapic_init(void);
+void lapic_ap_init(void);
+void lapic_timer_oneshot(uint32_t n);
+uint32_t lapic_timer_periodic(void);
+uint8_t lapic_id(void);
+void lapic_eoi(void);
+void lapic_send_ipi(uint8_t apic_id, uint8_t vector);
+void lapic_startup_aps(uint32_t entry_paddr);
+#endif
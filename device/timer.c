@@ -5,8 +5,16 @@
 #include "thread.h"
 #include "debug.h"
 #include "stdint.h"
+#include "sched.h"
+#include "list.h"
+#include "global.h"
+#include "spinlock.h"
+#include "smp.h"
+#include "lapic.h"
+#include "softirq.h"
+#include "vdso-init.h"
 
-#define IRQ0_FREQUENCY 100                      //咱们所期待的频率
+#define IRQ0_FREQUENCY TIMER_HZ                 //咱们所期待的频率
 #define INPUT_FREQUENCY 1193180                 //计数器平均CLK频率
 #define COUNTRE0_VALUE  INPUT_FREQUENCY / IRQ0_FREQUENCY    //计数器初值
 #define CONTRER0_PORT   0x40                    //计数器0的端口号
@@ -15,9 +23,43 @@
 #define READ_WRITE_LATCH 3                      //高低均写
 #define PIT_CONTROL_PORT 0x43                   //控制字端口号
 #define mil_seconds_per_intr (1000/IRQ0_FREQUENCY)  //10毫秒1次时钟中断
+#define ONESHOT_MODE    0                       //方式0,计数到0时触发一次中断
+#define LATCH_COMMAND   0                       //锁存计数值的命令
+#define NOHZ_MAX_TICKS  (0xffff / COUNTRE0_VALUE)   //单次触发最多能覆盖的tick数，16位计数器约为5个tick
+#define NOHZ_AP_TICKS   100                         //AP空闲时本地时钟的间隔，AP没有定时器，只需偶尔醒来
+
+/************************ 分层时间轮 ****************************
+ * 第1层有256个槽，每槽对应1个tick，
+ * 其后4层各有64个槽，第n层每槽对应2^(8+6(n-1))个tick，共覆盖32位的ticks。
+ * 定时器按到期时间与当前时间的差值放入相应层的槽中，加入和删除都是O(1)，
+ * 第1层转完一圈时把上一层对应槽中的定时器重新分配下来（cascade）
+ * **************************************************************/
+#define TVR_BITS 8
+#define TVN_BITS 6
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVN_SIZE (1 << TVN_BITS)
+#define TVR_MASK (TVR_SIZE - 1)
+#define TVN_MASK (TVN_SIZE - 1)
+#define TVN_LEVELS 4
 
 uint32_t ticks;         //ticks是内核自开中断开启以来总共的滴答数
 
+static struct list tv1[TVR_SIZE];               //第1层时间轮
+static struct list tvn[TVN_LEVELS][TVN_SIZE];   //第2～5层时间轮
+static uint32_t wheel_base;                     //时间轮中下一个待处理的tick
+static struct mcs_lock timer_lock;              //保护时间轮，定时器只在BSP的时钟软中断中处理，但各CPU都会添加，争用较多，用MCS锁
+static struct timer* volatile running_timer;    //回调正在锁外执行的定时器，timer_cancel要等它执行完
+
+/********** 空闲时停止周期时钟 **********
+ * 系统空闲时计算出下一个定时器的到期时间，
+ * 把PIT改为单次触发模式，直到那时才产生中断，
+ * 醒来后根据PIT中剩余的计数补记经过的ticks
+ * *************************************/
+static bool nohz_active;        //PIT当前是否处于单次触发模式
+static uint32_t nohz_ticks;     //单次触发模式下设定的tick数
+static uint32_t nohz_residual;  //提前醒来时不足1个tick的计数累积，满1个tick时补记
+static bool ap_nohz[MAX_CPUS];  //AP的本地时钟是否处于单次触发模式，只由该AP自己访问
+
 /* 把操作的计数器counter_no,读写锁属性rwl,计数器模式counter_mode
  * 写入模式控制寄存器并赋予初值 counter_value
  *  */
@@ -27,17 +69,227 @@ static void frequency_set(uint8_t counter_port, uint8_t counter_no, uint8_t rwl,
   /* 先写入counter_value的低8位 */
   outb(counter_port, (uint8_t)counter_value);
   /* 再写入counter_value的高8位 */
-  outb(counter_port, (uint8_t)counter_value >> 8);
+  outb(counter_port, (uint8_t)(counter_value >> 8));
+}
+
+
+/* 按照到期时间把timer放入时间轮中合适的槽，调用者需持有timer_lock */
+static void internal_add(struct timer* timer){
+  uint32_t expires = timer->expires;
+  uint32_t idx = expires - wheel_base;
+  struct list* vec;
+  if((int32_t)idx < 0){
+    /* 已经过期的定时器放到下一个待处理的槽中，尽快执行 */
+    vec = &tv1[wheel_base & TVR_MASK];
+  }else if(idx < TVR_SIZE){
+    vec = &tv1[expires & TVR_MASK];
+  }else{
+    uint32_t level = 0, shift = TVR_BITS;
+    /* 找到第一个能容纳此差值的层，最后一层覆盖剩余的所有位 */
+    while(level < TVN_LEVELS - 1 && idx >= ((uint32_t)1 << (shift + TVN_BITS))){
+      level++;
+      shift += TVN_BITS;
+    }
+    vec = &tvn[level][(expires >> shift) & TVN_MASK];
+  }
+  list_append(vec, &timer->tag);
+}
+
+/* 把第level+2层第index个槽中的定时器重新分配到下层，返回index */
+static uint32_t cascade(uint32_t level, uint32_t index){
+  struct list* vec = &tvn[level][index];
+  struct list pending;
+  list_init(&pending);
+  /* 先整体摘下，避免重新分配时又落回本槽 */
+  while(!list_empty(vec)){
+    list_append(&pending, list_pop(vec));
+  }
+  while(!list_empty(&pending)){
+    internal_add(elem2entry(struct timer, tag, list_pop(&pending)));
+  }
+  return index;
+}
+
+/* 处理所有已到期的定时器，在BSP的时钟软中断中调用，回调函数在锁外以调用前的中断状态执行 */
+static void run_timers(void){
+  struct mcs_node node;
+  enum intr_status old_status = mcs_lock_irqsave(&timer_lock, &node);
+  while((int32_t)(ticks - wheel_base) >= 0){
+    uint32_t index = wheel_base & TVR_MASK;
+    /* 第1层转完一圈，逐层向下分配，直到某一层没有进位为止 */
+    if(index == 0){
+      uint32_t level;
+      for(level = 0; level < TVN_LEVELS; level++){
+        if(cascade(level, (wheel_base >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK) != 0){
+          break;
+        }
+      }
+    }
+    wheel_base++;
+    while(!list_empty(&tv1[index])){
+      struct timer* timer = elem2entry(struct timer, tag, list_pop(&tv1[index]));
+      timer_func* func = timer->func;
+      void* arg = timer->arg;
+      /* 回调返回后不再访问timer，timer_cancel等到running_timer改变后所有者就可以释放它 */
+      timer->pending = false;
+      running_timer = timer;
+      mcs_unlock_irqrestore(&timer_lock, &node, old_status);
+      func(arg);
+      old_status = mcs_lock_irqsave(&timer_lock, &node);
+      running_timer = NULL;
+    }
+  }
+  mcs_unlock_irqrestore(&timer_lock, &node, old_status);
+}
+
+/* 初始化定时器timer，到期时调用func(arg) */
+void timer_setup(struct timer* timer, timer_func* func, void* arg){
+  timer->func = func;
+  timer->arg = arg;
+  timer->pending = false;
 }
 
+/* 让timer在ticks达到expires时到期，若timer已在时间轮中则先将其取下 */
+void timer_add(struct timer* timer, uint32_t expires){
+  struct mcs_node node;
+  enum intr_status old_status = mcs_lock_irqsave(&timer_lock, &node);
+  if(timer->pending){
+    list_remove(&timer->tag);
+  }
+  timer->expires = expires;
+  timer->pending = true;
+  internal_add(timer);
+  mcs_unlock(&timer_lock, &node);
+  /* BSP停掉周期时钟时是按加入此定时器之前的到期时间设定的，唤醒它重新计算 */
+  if(nohz_active){
+    smp_resched(0);
+  }
+  intr_set_status(old_status);
+}
+
+/* 取消timer，若timer尚未到期则返回true。
+ * 回调已在执行时等它返回，此后回调不会再运行，所有者可以释放timer，因此不能在回调中调用 */
+bool timer_cancel(struct timer* timer){
+  struct mcs_node node;
+  enum intr_status old_status = mcs_lock_irqsave(&timer_lock, &node);
+  bool was_pending = timer->pending;
+  if(was_pending){
+    list_remove(&timer->tag);
+    timer->pending = false;
+  }
+  /* 回调在BSP的软中断中执行，不会因等待它的线程而停下，自旋等待即可 */
+  while(running_timer == timer){
+    mcs_unlock_irqrestore(&timer_lock, &node, old_status);
+    cpu_relax();
+    old_status = mcs_lock_irqsave(&timer_lock, &node);
+  }
+  mcs_unlock_irqrestore(&timer_lock, &node, old_status);
+  return was_pending;
+}
+
+/* 睡眠定时器到期，唤醒睡眠的线程 */
+static void sleep_timeout(void* arg){
+  thread_unblock((struct task_struct*)arg);
+}
 
 /* 以tick为单位的sleep，任何时间形式的sleep都会转换此ticks形式 */
 static void ticks_to_sleep(uint32_t sleep_ticks){
-  uint32_t start_tick = ticks;
-  /* 若间隔的ticks数不够便让出CPU */
-  while(ticks - start_tick < sleep_ticks){
-    thread_yield();
+  struct timer timer;
+  struct task_struct* cur = running_thread();
+  timer_setup(&timer, sleep_timeout, cur);
+  /* 先置为阻塞态再加入定时器，定时器在BSP上提前到期时，
+   * thread_unblock会等到本线程切换出去后再唤醒它 */
+  enum intr_status old_status = intr_disable();
+  cur->status = TASK_BLOCKED;
+  timer_add(&timer, ticks + sleep_ticks);
+  schedule();
+  intr_set_status(old_status);
+  /* 定时器在本线程的栈上，被其他途径提前唤醒时要先从时间轮中取下，
+   * 回调恰好正在执行时等它返回，免得离开后再收到一次迟到的唤醒 */
+  timer_cancel(&timer);
+}
+
+/* 计算距下一个到期定时器还有多少个tick，最多计算到max个tick，
+ * 第1层时间轮转完一圈时上层的定时器会分配下来，因此也不能越过这一时刻 */
+static uint32_t timer_idle_ticks(uint32_t max){
+  uint32_t delta;
+  for(delta = 0; delta < max; delta++){
+    uint32_t index = (wheel_base + delta) & TVR_MASK;
+    if(!list_empty(&tv1[index]) || (index == 0 && delta != 0)){
+      break;
+    }
   }
+  /* wheel_base处的槽将在下一个tick处理，delta为0时也至少要等1个tick */
+  return delta + 1 > max ? max : delta + 1;
+}
+
+/* 读出计数器0中剩余的计数值 */
+static uint16_t counter_read(void){
+  outb(PIT_CONTROL_PORT, (uint8_t)(COUNTER0_NO << 6 | LATCH_COMMAND << 4));
+  uint8_t low = inb(CONTRER0_PORT);
+  uint8_t high = inb(CONTRER0_PORT);
+  return (uint16_t)(high << 8 | low);
+}
+
+/* 退出单次触发模式并恢复周期模式，返回单次触发期间经过的tick数 */
+static uint32_t nohz_stop(bool expired){
+  uint32_t elapsed = nohz_ticks;
+  if(!expired){
+    /* 被其他中断提前唤醒，按已经计过的数折算ticks，不足1个tick的部分累积起来 */
+    uint32_t counts = nohz_ticks * COUNTRE0_VALUE - counter_read() + nohz_residual;
+    elapsed = counts / COUNTRE0_VALUE;
+    nohz_residual = counts % COUNTRE0_VALUE;
+  }
+  nohz_active = false;
+  frequency_set(CONTRER0_PORT, COUNTER0_NO, READ_WRITE_LATCH, COUNTER_MODE, COUNTRE0_VALUE);
+  return elapsed;
+}
+
+/* idle线程在hlt之前调用，调用者需关中断，
+ * BSP若下一个定时器在2个tick以后才到期，就把PIT设为届时触发一次；
+ * 定时器都在BSP上处理，AP只负责本地调度，空闲时把本地时钟改为NOHZ_AP_TICKS后触发一次，
+ * 有线程要它运行或别的CPU积压了就绪线程时会收到重新调度的IPI */
+void tick_nohz_idle_enter(void){
+  ASSERT(intr_get_status() == INTR_OFF);
+  uint8_t cpu = cpu_id();
+  if(cpu != 0){
+    ap_nohz[cpu] = true;
+    lapic_timer_oneshot(NOHZ_AP_TICKS);
+    return;
+  }
+  struct mcs_node node;
+  mcs_lock(&timer_lock, &node);
+  uint32_t sleep_ticks = timer_idle_ticks(NOHZ_MAX_TICKS);
+  mcs_unlock(&timer_lock, &node);
+  if(sleep_ticks <= 1){
+    return;
+  }
+  nohz_ticks = sleep_ticks;
+  nohz_active = true;
+  frequency_set(CONTRER0_PORT, COUNTER0_NO, READ_WRITE_LATCH, ONESHOT_MODE, COUNTRE0_VALUE * sleep_ticks);
+}
+
+/* idle线程从hlt醒来后调用，BSP若是被时钟以外的中断提前唤醒，补记经过的ticks，AP补记本地的运行时间，再恢复周期模式 */
+void tick_nohz_idle_exit(void){
+  enum intr_status old_status = intr_disable();
+  uint8_t cpu = cpu_id();
+  if(cpu != 0){
+    if(ap_nohz[cpu]){
+      ap_nohz[cpu] = false;
+      running_thread()->elapsed_ticks += lapic_timer_periodic();
+    }
+  }else if(nohz_active){
+    uint16_t remain = counter_read();
+    /* 计数已到0时时钟中断正在路上，交给中断处理程序补记 */
+    if(remain != 0 && remain <= nohz_ticks * COUNTRE0_VALUE){
+      uint32_t elapsed = nohz_stop(false);
+      running_thread()->elapsed_ticks += elapsed;
+      ticks += elapsed;
+      vdso_update();
+      run_timers();
+    }
+  }
+  intr_set_status(old_status);
 }
 
 /* 以毫秒为单位的sleep */
@@ -48,24 +300,59 @@ void mtime_sleep(uint32_t m_seconds){
 }
 
 
-/* 时钟的中断处理函数 */
-static void intr_timer_handler(void){
-  struct task_struct* cur_thread = running_thread();
+/* 本CPU的时钟节拍：记录当前线程占用的CPU时间，检查时间片 */
+static void local_tick(struct task_struct* cur_thread, uint32_t delta){
   ASSERT(cur_thread->stack_magic == 0xdeadbeef);    //检查栈是否溢出
-  cur_thread->elapsed_ticks++;          //记录此线程占用的CPU时间
-  ticks++;          //从内核第一次处理时间中断后开始至今的滴答数，内核态和用户态总共的滴答数
-  if(cur_thread->ticks == 0){   //查看时间片是否用完
-    schedule();
+  cur_thread->elapsed_ticks += delta;   //记录此线程占用的CPU时间
+  sched_tick(cur_thread, delta);    //累加公平调度的vruntime，多级反馈队列的周期性提升
+  if(cur_thread->ticks == 0){   //查看时间片是否用完，用完则在中断返回时调度
+    this_cpu()->need_resched = true;
   }else{
     cur_thread->ticks--;
   }
 }
 
+/* 时钟的中断处理函数，PIT只向BSP发中断，由BSP负责全局的ticks和定时器 */
+static void intr_timer_handler(void){
+  uint32_t delta = 1;
+  if(nohz_active){  //单次触发到期，空闲期间经过了nohz_ticks个tick
+    delta = nohz_stop(true);
+  }
+  ticks += delta;   //从内核第一次处理时间中断后开始至今的滴答数，内核态和用户态总共的滴答数
+  vdso_update();    //用户态通过共享数据页读取ticks
+  raise_softirq(SOFTIRQ_TIMER);     //到期的定时器在中断返回时开中断处理
+  local_tick(running_thread(), delta);
+}
+
+/* AP本地APIC定时器的中断处理函数，与PIT同频，只负责本CPU的调度 */
+static void intr_lapic_timer_handler(void){
+  lapic_eoi();
+  local_tick(running_thread(), 1);
+}
+
 /* 初始化PIT8253 */
 void timer_init(){
   put_str("timer_init start\n");
   /* 设置8253的定时周期，也就是发中断的周期 */
   frequency_set(CONTRER0_PORT, COUNTER0_NO, READ_WRITE_LATCH, COUNTER_MODE, COUNTRE0_VALUE);
+  /* 初始化时间轮 */
+  uint32_t idx, level;
+  for(idx = 0; idx < TVR_SIZE; idx++){
+    list_init(&tv1[idx]);
+  }
+  for(level = 0; level < TVN_LEVELS; level++){
+    for(idx = 0; idx < TVN_SIZE; idx++){
+      list_init(&tvn[level][idx]);
+    }
+  }
+  wheel_base = ticks;
+  running_timer = NULL;
+  for(idx = 0; idx < MAX_CPUS; idx++){
+    ap_nohz[idx] = false;
+  }
+  mcs_lock_init(&timer_lock);
+  open_softirq(SOFTIRQ_TIMER, run_timers);
   register_handler(0x20, intr_timer_handler);
+  register_handler(LAPIC_TIMER_VECTOR, intr_lapic_timer_handler);
   put_str("timer_init_done\n");
 }
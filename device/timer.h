@@ -1,9 +1,32 @@
 #ifndef __DEVICE_TIMER_H
 #define __DEVICE_TIMER_H
 #include "stdint.h"
+#include "global.h"
+#include "list.h"
+
+/* 定时器到期时调用的回调函数，在BSP的时钟软中断中执行，不能阻塞 */
+typedef void timer_func(void* arg);
+
+/* 内核定时器 */
+struct timer{
+  struct list_elem tag;     //用于挂在时间轮的槽中
+  uint32_t expires;         //到期时的ticks
+  timer_func* func;         //到期回调
+  void* arg;                //回调参数
+  bool pending;             //是否已加入时间轮且尚未到期
+};
+
+#define TIMER_HZ 100    //每秒的时钟中断数
+
+extern uint32_t ticks;  //内核自开中断以来总共的滴答数
 
 void timer_init(void);  //初始化PIT
 
 void mtime_sleep(uint32_t m_seconds);
+void timer_setup(struct timer* timer, timer_func* func, void* arg);
+void timer_add(struct timer* timer, uint32_t expires);
+bool timer_cancel(struct timer* timer);
+void tick_nohz_idle_enter(void);
+void tick_nohz_idle_exit(void);
 
 #endif
@@ -256,6 +256,8 @@ void filesys_init(){
   /* 确定默认操作的分区 */
   char default_part[8] = "sdb1";
   /* 挂载分区 */
+  read_lock(&partition_lock);
   list_traversal(&partition_list, mount_partition, (int)default_part);
+  read_unlock(&partition_lock);
   printk("filesystem init done\n");
 }
\ No newline at end of file
@@ -13,6 +13,9 @@ enum file_types {
     FT_DIRECTORY    // 目录
 };
 
+struct partition;
+extern struct partition* cur_part;    //默认操作的分区
+
 /* 文件系统初始化 */
 void filesys_init(void);
 
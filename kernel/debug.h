@@ -19,4 +19,12 @@ void panic_spin(char* filename, int line, const char* func, const char* conditio
     }
 
 #endif /*__NDEBUG*/
+
+/* 需要遍历等代价较高的一致性检查，默认不进行，
+ * 排查问题时以make DEBUG_SLOW=1构建（定义DEBUG_SLOW）才开启，普通的ASSERT不受影响 */
+#if defined(DEBUG_SLOW) && !defined(NDEBUG)
+  #define ASSERT_SLOW(CONDITION) ASSERT(CONDITION)
+#else
+  #define ASSERT_SLOW(CONDITION) ((void)0)
+#endif
 #endif /*__KERNEL_DEBUG_H*/
@@ -0,0 +1,135 @@
+#include "fpu.h"
+#include "stdint.h"
+#include "global.h"
+#include "interrupt.h"
+#include "thread.h"
+#include "smp.h"
+#include "print.h"
+
+#define CR0_MP (1 << 1)         //置位时wait/fwait也受TS影响
+#define CR0_EM (1 << 2)         //置位时FPU指令一律触发#NM，须清0
+#define CR0_TS (1 << 3)         //任务切换标志，置位时FPU/SSE指令触发#NM
+#define CR0_NE (1 << 5)         //x87错误以#MF异常报告，而不是经8259A的IRQ13
+#define CR4_OSFXSR (1 << 9)     //操作系统支持fxsave/fxrstor，允许使用SSE
+#define CR4_OSXMMEXCPT (1 << 10)    //SIMD浮点错误以#XF异常报告
+#define CPUID_FXSR (1 << 24)
+#define CPUID_SSE (1 << 25)
+#define MXCSR_DEFAULT 0x1f80    //屏蔽所有SIMD浮点异常，就近舍入
+#define NM_VECTOR 0x07
+
+static bool has_fxsr;           //支持fxsave/fxrstor，否则用fnsave/frstor
+static bool has_sse;
+
+static inline uint32_t read_cr0(void){
+  uint32_t cr0;
+  asm volatile ("movl %%cr0, %0" : "=r"(cr0));
+  return cr0;
+}
+
+static inline void write_cr0(uint32_t cr0){
+  asm volatile ("movl %0, %%cr0" : : "r"(cr0) : "memory");
+}
+
+static inline void clts(void){
+  asm volatile ("clts" : : : "memory");
+}
+
+/* 把寄存器中的FPU状态保存到state */
+static void fpu_save(struct fpu_state* state){
+  if(has_fxsr){
+    asm volatile ("fxsave %0" : "=m"(*state));
+  }else{
+    asm volatile ("fnsave %0; fwait" : "=m"(*state));
+  }
+}
+
+/* 从state恢复FPU状态 */
+static void fpu_restore(struct fpu_state* state){
+  if(has_fxsr){
+    asm volatile ("fxrstor %0" : : "m"(*state));
+  }else{
+    asm volatile ("frstor %0" : : "m"(*state));
+  }
+}
+
+/* 把FPU置为初始状态，供第一次使用FPU的线程 */
+static void fpu_reset(void){
+  asm volatile ("fninit");
+  if(has_sse){
+    uint32_t mxcsr = MXCSR_DEFAULT;
+    asm volatile ("ldmxcsr %0" : : "m"(mxcsr));
+  }
+}
+
+/* #NM处理程序，当前线程第一次用FPU时把它的状态装入寄存器 */
+static void intr_nm_handler(void){
+  struct task_struct* cur = running_thread();
+  struct cpu* cpu = &cpus[cur->cpu];
+  clts();
+  /* 寄存器中仍是cur上次在本CPU上留下的状态，此后它也没在别的CPU上用过FPU */
+  if(cpu->fpu_owner == cur && cur->fpu_cpu == cpu->id){
+    return;
+  }
+  if(cur->fpu_used){
+    fpu_restore(&cur->fpu);
+  }else{
+    fpu_reset();
+    cur->fpu_used = true;
+  }
+  cpu->fpu_owner = cur;
+  cur->fpu_cpu = cpu->id;
+}
+
+/* 每个CPU都要做的设置：允许FPU和SSE，初始化后置TS，等第一次使用时再装入状态 */
+static void fpu_cpu_setup(void){
+  uint32_t cr0 = read_cr0();
+  cr0 &= ~(CR0_EM | CR0_TS);
+  cr0 |= CR0_MP | CR0_NE;
+  write_cr0(cr0);
+  if(has_sse){
+    uint32_t cr4;
+    asm volatile ("movl %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    asm volatile ("movl %0, %%cr4" : : "r"(cr4));
+  }
+  asm volatile ("fninit");
+  this_cpu()->fpu_owner = NULL;
+  write_cr0(cr0 | CR0_TS);
+}
+
+/* BSP检测FPU特性并注册#NM处理程序 */
+void fpu_init(void){
+  put_str("fpu_init start\n");
+  uint32_t eax = 1, ebx, ecx = 0, edx;
+  asm volatile ("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+  has_fxsr = (edx & CPUID_FXSR) != 0;
+  has_sse = has_fxsr && (edx & CPUID_SSE) != 0;
+  register_handler(NM_VECTOR, intr_nm_handler);
+  fpu_cpu_setup();
+  put_str("fpu_init done\n");
+}
+
+/* AP启动时调用 */
+void fpu_ap_init(void){
+  fpu_cpu_setup();
+}
+
+/* 新线程还没有FPU状态，第一次使用时才初始化 */
+void fpu_task_init(struct task_struct* pthread){
+  pthread->fpu_used = false;
+  pthread->fpu_cpu = FPU_NO_CPU;
+}
+
+/* 切换线程前调用，TS为0说明prev在本次运行中用过FPU，寄存器中是其最新状态，
+ * 要先保存下来，prev下次可能在别的CPU上运行。
+ * 保存后寄存器内容不变，prev回到本CPU且期间没有别人用过FPU时无需再恢复 */
+void fpu_switch_out(struct task_struct* prev){
+  uint32_t cr0 = read_cr0();
+  if(!(cr0 & CR0_TS)){
+    fpu_save(&prev->fpu);
+    if(!has_fxsr){
+      cpus[prev->cpu].fpu_owner = NULL;     //fnsave保存后会重新初始化FPU，寄存器中已不是prev的状态
+    }
+    write_cr0(cr0 | CR0_TS);
+  }
+}
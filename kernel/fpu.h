@@ -0,0 +1,25 @@
+#ifndef __KERNEL_FPU_H
+#define __KERNEL_FPU_H
+#include "stdint.h"
+#include "global.h"
+
+struct task_struct;
+
+#define FPU_STATE_SIZE 512      //fxsave保存的字节数，fnsave只用前108字节
+#define FPU_NO_CPU 0xff         //状态不在任何CPU的寄存器中
+
+/************* FPU/SSE状态的惰性切换 *************
+ * 切换线程时只置CR0.TS，线程第一次执行FPU/SSE指令时触发#NM，
+ * 在#NM中才把该线程的状态装入寄存器；
+ * 切出时只有本次运行中用过FPU的线程才保存状态，
+ * 不用FPU的线程在切换时只多读一次CR0
+ * ***********************************************/
+struct fpu_state{
+  uint8_t area[FPU_STATE_SIZE];
+} __attribute__((aligned(16)));  //fxsave/fxrstor要求16字节对齐
+
+void fpu_init(void);
+void fpu_ap_init(void);
+void fpu_task_init(struct task_struct* pthread);
+void fpu_switch_out(struct task_struct* prev);
+#endif
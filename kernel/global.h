@@ -42,8 +42,15 @@
 #define SELECTOR_U_CODE	   ((5 << 3) + (TI_GDT << 2) + RPL3)
 #define SELECTOR_U_DATA	   ((6 << 3) + (TI_GDT << 2) + RPL3)
 #define SELECTOR_U_STACK   SELECTOR_U_DATA
+/* sysenter/sysexit按IA32_SYSENTER_CS依次取内核代码段、内核数据段、用户代码段、用户数据段，
+ * 要求这四个描述符相邻，故在第7~10项另建一组，kernel.S中的同名常量须与此一致 */
+#define SELECTOR_SYSENTER_CS ((7 << 3) + (TI_GDT << 2) + RPL0)
+#define SELECTOR_SYSEXIT_CS  ((9 << 3) + (TI_GDT << 2) + RPL3)
+#define SELECTOR_SYSEXIT_SS  ((10 << 3) + (TI_GDT << 2) + RPL3)
 
 #define GDT_ATTR_HIGH		 ((DESC_G_4K << 7) + (DESC_D_32 << 6) + (DESC_L << 5) + (DESC_AVL << 4))
+#define GDT_CODE_ATTR_LOW_DPL0	 ((DESC_P << 7) + (DESC_DPL_0 << 5) + (DESC_S_CODE << 4) + DESC_TYPE_CODE)
+#define GDT_DATA_ATTR_LOW_DPL0	 ((DESC_P << 7) + (DESC_DPL_0 << 5) + (DESC_S_DATA << 4) + DESC_TYPE_DATA)
 #define GDT_CODE_ATTR_LOW_DPL3	 ((DESC_P << 7) + (DESC_DPL_3 << 5) + (DESC_S_CODE << 4) + DESC_TYPE_CODE)
 #define GDT_DATA_ATTR_LOW_DPL3	 ((DESC_P << 7) + (DESC_DPL_3 << 5) + (DESC_S_DATA << 4) + DESC_TYPE_DATA)
 
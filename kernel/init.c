@@ -11,18 +11,34 @@
 #include "init.h"
 #include "fs.h"
 #include "ide.h"
+#include "smp.h"
+#include "fpu.h"
+#include "futex.h"
+#include "softirq.h"
+#include "workqueue.h"
+#include "rcu.h"
+#include "vdso-init.h"
 
 /* 负责初始化所有模块 */
 void init_all(){
   put_str("init_all\n");
   idt_init();       //初始化中断
   mem_init();       //初始化内存
+  smp_early_init(); //登记BSP，thread_init要用到每CPU的信息
   thread_init();    //初始化多线程
+  futex_init();     //初始化futex哈希表
+  softirq_init();   //初始化软中断，须在各驱动注册中断处理程序之前
+  workqueue_init(); //创建工作线程
+  rcu_init();       //初始化RCU，回调在工作线程中执行
+  fpu_init();       //开启FPU和SSE，#NM处理程序要用到当前线程
   timer_init();     //初始化PIT，依赖thread排在thread_init后
+  vdso_init();      //初始化用户共享数据页，时钟中断会更新它
   console_init();   //初始化终端
   keyboard_init();  //初始化键盘
   tss_init();       //初始化TSS 
   syscall_init();  //初始化系统调用
   ide_init();     //初始化硬盘
   filesys_init();   //初始化文件系统
+  vdso_calibrate(); //校准TSC，要开中断，须在各中断处理程序都注册之后
+  smp_init();       //启动其他CPU，须在创建用户进程之前
 }
@@ -3,8 +3,13 @@
 #include "global.h"
 #include "io.h"
 #include "print.h"
+#include "string.h"
+#include "thread.h"
+#include "irqtrace.h"
+#include "softirq.h"
 
 #define IDT_DESC_CNT 0x81           //目前总支持的中断数
+#define INTR_ENTRY_CNT 0x40         //kernel.S中intr_entry_table的项数，其余向量除0x80外不可用
 #define PIC_M_CTRL 0x20             //主片控制端口
 #define PIC_M_DATA 0x21             //主片数据端口
 #define PIC_S_CTRL 0xA0             //从片控制端口
@@ -31,7 +36,7 @@ char* intr_name[IDT_DESC_CNT];              //用于保存异常的名字，这
 
 intr_handler idt_table[IDT_DESC_CNT];       //定义中断处理程序地址数组
 
-extern intr_handler intr_entry_table[IDT_DESC_CNT];     //声明引用在kernel.S中的中断处理函数入口数组
+extern intr_handler intr_entry_table[INTR_ENTRY_CNT];     //声明引用在kernel.S中的中断处理函数入口数组
 extern uint32_t syscall_handler(void);      //单独的系统调用中断处理函数例程
 
 /* 初始化可编程中断控制器 */
@@ -68,7 +73,11 @@ static void make_idt_desc(struct gate_desc* p_gdesc, uint8_t attr, intr_handler
 static void idt_desc_init(void){
   int i, lastindex = IDT_DESC_CNT-1;
   for(i = 0;i < IDT_DESC_CNT; i++){
-    make_idt_desc(&idt[i],IDT_DESC_ATTR_DPL0, intr_entry_table[i]);
+    if(i < INTR_ENTRY_CNT){
+      make_idt_desc(&idt[i],IDT_DESC_ATTR_DPL0, intr_entry_table[i]);
+    }else{
+      memset(&idt[i], 0, sizeof(struct gate_desc));   //P位为0，没有入口的向量不可用
+    }
   }
   
   /* 单独处理系统调用，因为这里要使得用户能直接使用，所以系统调用对应的中断门dpl应为3,
@@ -136,25 +145,28 @@ static void exception_init(void){
   intr_name[19] = "#XF SIMD Floating-Point Exception";
 }
 
-/* 开中断并返回开中断前的状态 */
-enum intr_status intr_enable(){
+/* 开中断并返回开中断前的状态，caller是开中断者，供关中断追踪使用 */
+static enum intr_status do_intr_enable(void* caller){
   enum intr_status old_status;
   if (INTR_ON == intr_get_status()){
     old_status = INTR_ON;
     return old_status;
   }else{
     old_status = INTR_OFF;
+    IRQTRACE_ON(caller);
     asm volatile("sti");     //开中断，sti指令将IF位置为1
     return old_status;
   }
 }
 
-/* 关中断并返回关中断前的状态 */
-enum intr_status intr_disable(){
+/* 关中断并返回关中断前的状态，caller是关中断者。
+ * spin_lock_irqsave等包装函数把自己的调用者传进来，追踪报告才能指出真正的代码路径 */
+enum intr_status do_intr_disable(void* caller){
   enum intr_status old_status;
   if(INTR_ON == intr_get_status()){
     old_status = INTR_ON;
     asm volatile("cli" : : : "memory");
+    IRQTRACE_OFF(caller);
     return old_status;
   }else{
     old_status = INTR_OFF;
@@ -162,9 +174,39 @@ enum intr_status intr_disable(){
   }
 }
 
+/* 开中断并返回开中断前的状态 */
+enum intr_status intr_enable(){
+  return do_intr_enable(__builtin_return_address(0));
+}
+
+/* 关中断并返回关中断前的状态 */
+enum intr_status intr_disable(){
+  return do_intr_disable(__builtin_return_address(0));
+}
+
+/* 将中断状态设置为status，caller是开关中断者 */
+enum intr_status do_intr_set_status(enum intr_status status, void* caller){
+  return status & INTR_ON ? do_intr_enable(caller) : do_intr_disable(caller);
+}
+
 /* 将中断状态设置为status */
 enum intr_status intr_set_status(enum intr_status status){
-  return status & INTR_ON ? intr_enable() : intr_disable();
+  return do_intr_set_status(status, __builtin_return_address(0));
+}
+
+/* intr_exit在恢复上下文之前调用，frame是栈中保存的上下文：
+ * 被中断的代码开着中断时先开中断处理软中断，再处理本CPU的重新调度请求，
+ * 返回到正在处理的软中断中时两者都不做。若iretd会开中断，关中断区间到此结束 */
+void intr_exit_work(struct intr_stack* frame){
+  if(!softirq_active()){
+    if(frame->eflags & EFLAGS_IF){
+      do_softirq();
+    }
+    preempt_check_resched();
+  }
+  if(frame->eflags & EFLAGS_IF){
+    IRQTRACE_ON((void*)frame->eip);
+  }
 }
 
 /* 获取当前中断状态 */
@@ -187,9 +229,13 @@ void idt_init(){
   exception_init();         //异常名初始化并注册通常的中断处理函数
   pic_init();               //初始化8259A
 
-  /* 加载idt */
+  idt_load();
+  put_str("idt_init done\n");
+}
+
+/* 加载idt，所有CPU共用同一个idt，AP启动时也调用此函数 */
+void idt_load(void){
   uint64_t idt_operand = ((sizeof(idt)-1) | ((uint64_t)(uint32_t)idt << 16));   //这里(sizeof(idt)-1)是表示段界限，占16位，然后我们的idt地址左移16位表示高32位，表示idt首地址
   asm volatile("lidt %0" : : "m" (idt_operand)); 
-  put_str("idt_init done\n");
 }
 
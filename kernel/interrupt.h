@@ -5,6 +5,7 @@
 
 typedef void* intr_handler;
 void idt_init(void);    //初始化idt描述表
+void idt_load(void);    //加载idt
 
 /* 定义两种中断的状态
  * INTR_OFF值为0表示关中断
@@ -19,7 +20,11 @@ enum intr_status intr_get_status(void);
 enum intr_status intr_set_status(enum intr_status);
 enum intr_status intr_enable(void);
 enum intr_status intr_disable(void);
+enum intr_status do_intr_disable(void* caller);
+enum intr_status do_intr_set_status(enum intr_status status, void* caller);
 
 void register_handler(uint8_t vector_no, intr_handler function);    //中断处理程序注册入口
+struct intr_stack;
+void intr_exit_work(struct intr_stack* frame);
 
 #endif
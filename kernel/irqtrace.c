@@ -0,0 +1,119 @@
+#include "irqtrace.h"
+#include "stdint.h"
+#include "global.h"
+#include "string.h"
+#include "interrupt.h"
+#include "thread.h"
+#include "smp.h"
+#include "stdio-kernel.h"
+
+bool irqtrace_enabled = false;  //默认关闭
+
+/* 每个CPU的追踪状态，只由本CPU在关中断时访问，无需加锁 */
+struct irqtrace_cpu{
+  bool active;                  //已记录关中断的时刻，尚未开中断
+  uint32_t start;               //关中断时TSC的低32位，区间不会长到让它回绕
+  void* off_caller;
+  struct irqtrace_stat stat;
+};
+
+static struct irqtrace_cpu trace_cpus[MAX_CPUS];
+
+/* 读时间戳计数器的低32位 */
+static inline uint32_t rdtsc_low(void){
+  uint32_t low, high;
+  asm volatile ("rdtsc" : "=a"(low), "=d"(high));
+  return low;
+}
+
+/* 返回最高置位的下标，val不为0 */
+static uint32_t last_set_bit(uint32_t val){
+  uint32_t idx;
+  asm ("bsrl %1, %0" : "=r"(idx) : "rm"(val));
+  return idx;
+}
+
+/* 清空统计并开启追踪 */
+void irqtrace_enable(void){
+  enum intr_status old_status = intr_disable();
+  memset(trace_cpus, 0, sizeof(trace_cpus));
+  irqtrace_enabled = true;
+  intr_set_status(old_status);
+}
+
+/* 关闭追踪，已有统计保留 */
+void irqtrace_disable(void){
+  irqtrace_enabled = false;
+}
+
+/* 中断刚由开变关，caller是关中断者 */
+void irqtrace_off(void* caller){
+  struct irqtrace_cpu* tc = &trace_cpus[cpu_id()];
+  tc->active = true;
+  tc->off_caller = caller;
+  tc->start = rdtsc_low();
+}
+
+/* 中断即将由关变开，caller是开中断者，此时仍处在关中断状态 */
+void irqtrace_on(void* caller){
+  struct irqtrace_cpu* tc = &trace_cpus[cpu_id()];
+  if(!tc->active){      //开启追踪之前或由硬件关的中断
+    return;
+  }
+  uint32_t cycles = rdtsc_low() - tc->start;
+  tc->active = false;
+  struct irqtrace_stat* stat = &tc->stat;
+  stat->count++;
+  stat->hist[cycles == 0 ? 0 : last_set_bit(cycles)]++;
+  if(cycles > stat->max_cycles){
+    stat->max_cycles = cycles;
+    stat->max_off_caller = tc->off_caller;
+    stat->max_on_caller = caller;
+  }
+}
+
+/* 输出各CPU最长的关中断区间和所有CPU合计的分布 */
+void irqtrace_report(void){
+  struct irqtrace_stat stats[MAX_CPUS];
+  uint32_t total[IRQTRACE_BUCKETS];
+  uint32_t cpu, idx;
+  /* 先拷贝一份快照，打印时会申请终端锁，不能在关中断时进行 */
+  enum intr_status old_status = intr_disable();
+  for(cpu = 0; cpu < cpu_cnt; cpu++){
+    stats[cpu] = trace_cpus[cpu].stat;
+  }
+  intr_set_status(old_status);
+
+  memset(total, 0, sizeof(total));
+  printk("irqtrace: %s\n", irqtrace_enabled ? "on" : "off");
+  for(cpu = 0; cpu < cpu_cnt; cpu++){
+    printk("  cpu %d: sections:%d max_cycles:%d off:0x%x on:0x%x\n", cpu, stats[cpu].count, \
+        stats[cpu].max_cycles, (uint32_t)stats[cpu].max_off_caller, (uint32_t)stats[cpu].max_on_caller);
+    for(idx = 0; idx < IRQTRACE_BUCKETS; idx++){
+      total[idx] += stats[cpu].hist[idx];
+    }
+  }
+  printk("  cycles histogram:\n");
+  for(idx = 0; idx < IRQTRACE_BUCKETS; idx++){
+    if(total[idx] != 0){
+      printk("    >=2^%d: %d\n", idx, total[idx]);
+    }
+  }
+}
+
+/* 系统调用irqtrace，运行时开关追踪或输出报告，成功返回0，命令无效返回-1 */
+int32_t sys_irqtrace(uint32_t cmd){
+  switch(cmd){
+    case IRQTRACE_CMD_ENABLE:
+      irqtrace_enable();
+      return 0;
+    case IRQTRACE_CMD_DISABLE:
+      irqtrace_disable();
+      return 0;
+    case IRQTRACE_CMD_REPORT:
+      irqtrace_report();
+      return 0;
+    default:
+      return -1;
+  }
+}
@@ -0,0 +1,46 @@
+#ifndef __KERNEL_IRQTRACE_H
+#define __KERNEL_IRQTRACE_H
+#include "stdint.h"
+#include "global.h"
+
+/************* 关中断时长追踪 *************
+ * 在intr_disable/intr_enable/intr_set_status以及中断返回处记录开关中断的时刻（TSC），
+ * 经由spin_lock_irqsave等包装函数开关中断时，记录的是包装函数的调用者，
+ * 每个CPU统计关中断区间长度的分布和最长的区间及其首尾的调用者。
+ * 中断门进入处理程序时由硬件关中断，这段时间不计入。用户态通过系统调用irqtrace开关和输出报告
+ * ****************************************/
+#define IRQTRACE_BUCKETS 32     //第n个桶统计长度在[2^n, 2^(n+1))个时钟周期的区间
+
+/* 一个CPU的统计 */
+struct irqtrace_stat{
+  uint32_t count;               //记录到的区间数
+  uint32_t max_cycles;          //最长区间的时钟周期数
+  void* max_off_caller;         //最长区间由谁关的中断
+  void* max_on_caller;          //最长区间由谁开的中断
+  uint32_t hist[IRQTRACE_BUCKETS];
+};
+
+extern bool irqtrace_enabled;
+
+/* 开关中断路径上的挂钩，关闭追踪时只有一次比较的开销 */
+#define IRQTRACE_OFF(CALLER) do{ \
+  if(irqtrace_enabled){ irqtrace_off(CALLER); } \
+}while(0)
+#define IRQTRACE_ON(CALLER) do{ \
+  if(irqtrace_enabled){ irqtrace_on(CALLER); } \
+}while(0)
+
+/* 系统调用irqtrace的命令 */
+enum irqtrace_cmd{
+  IRQTRACE_CMD_ENABLE,      //清空统计并开启
+  IRQTRACE_CMD_DISABLE,
+  IRQTRACE_CMD_REPORT
+};
+
+void irqtrace_enable(void);
+void irqtrace_disable(void);
+void irqtrace_off(void* caller);
+void irqtrace_on(void* caller);
+void irqtrace_report(void);
+int32_t sys_irqtrace(uint32_t cmd);
+#endif
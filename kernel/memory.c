@@ -8,6 +8,9 @@
 #include "sync.h"
 #include "thread.h"
 #include "interrupt.h"
+#include "memtrace.h"
+#include "stdio-kernel.h"
+#include "smp.h"
 
 /************************ 位图地址 ****************************/
 #define MEM_BITMAP_BASE 0xc009a000
@@ -30,6 +33,8 @@ struct pool{
   uint32_t phy_addr_start;      //本内存池的物理起始地址
   uint32_t pool_size;
   struct lock lock; 
+  uint32_t used_pages;          //已分配出去的页框数
+  uint32_t alloc_fail;          //分配失败次数
 };
 
 /* 内存仓库 */
@@ -43,6 +48,19 @@ struct arena{
 
 struct mem_block_desc k_block_descs[DESC_CNT];  //内核内存块描述符数组
 
+/* 各内存块规格，由小到大排列 */
+static const uint16_t block_sizes[DESC_CNT] = {
+  16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1360, 2040
+};
+/* 按16字节为粒度的规格索引表，size_class_idx[(size - 1) >> 4]即为能容纳size的最小规格 */
+static uint8_t size_class_idx[DIV_ROUND_UP(MAX_BLOCK_SIZE, 16)];
+
+/* 内核已释放大块arena的缓存，large_cache[n - 1]存放n页的arena，
+ * 复用时无需重新映射页表和刷新tlb，由kernel_pool.lock保护 */
+static struct arena* large_cache[LARGE_CACHE_PAGES][LARGE_CACHE_DEPTH];
+static uint32_t large_cache_cnt[LARGE_CACHE_PAGES];
+static uint32_t large_cache_hits;
+
 struct pool kernel_pool, user_pool; //生成内核物理内存池和用户物理内存池
 struct virtual_addr kernel_vaddr;   //此结构用来给内核分配虚拟地址
 
@@ -61,14 +79,14 @@ static void* vaddr_get(enum pool_flags pf, uint32_t pg_cnt){
     vaddr_start = kernel_vaddr.vaddr_start + bit_idx_start * PG_SIZE;
   }else{    //如果申请的是用户内存池
     struct task_struct* cur = running_thread();
-    bit_idx_start = bitmap_scan(&cur->userprog_vaddr.vaddr_bitmap, pg_cnt);     //查找当前线程的虚拟用户内存池
+    bit_idx_start = bitmap_scan(&cur->mm->userprog_vaddr.vaddr_bitmap, pg_cnt);     //查找当前进程的虚拟用户内存池
     if(bit_idx_start == -1){
       return NULL;
     }
     while(cnt < pg_cnt){
-      bitmap_set(&cur->userprog_vaddr.vaddr_bitmap, bit_idx_start + cnt++, 1);
+      bitmap_set(&cur->mm->userprog_vaddr.vaddr_bitmap, bit_idx_start + cnt++, 1);
     } 
-    vaddr_start = cur->userprog_vaddr.vaddr_start + bit_idx_start * PG_SIZE;
+    vaddr_start = cur->mm->userprog_vaddr.vaddr_start + bit_idx_start * PG_SIZE;
     /* (0xc0000000 - PG_SIZE)作为用户3级栈已经在start_process被分配 */
     ASSERT((uint32_t)vaddr_start < (0xc0000000 - PG_SIZE));
 
@@ -100,6 +118,7 @@ static void* palloc(struct pool* m_pool){
     return NULL;
   }
   bitmap_set(&m_pool->pool_bitmap, bit_idx, 1);         //将对应位置1
+  m_pool->used_pages++;
   uint32_t page_phyaddr = ((bit_idx * PG_SIZE) + m_pool->phy_addr_start);
   return (void*)page_phyaddr;
 }
@@ -125,8 +144,10 @@ static void page_table_add(void* _vaddr, void* _page_phyaddr){
     }
   }else{
     //页目录项不存在，所以需要先创建页目录再创建页表项
-    /* 页表中的页框一律从内核空间分配 */
+    /* 页表中的页框一律从内核空间分配，分配用户内存时调用者只持有user_pool.lock */
+    lock_acquire(&kernel_pool.lock);
     uint32_t pde_phyaddr = (uint32_t)palloc(&kernel_pool);
+    lock_release(&kernel_pool.lock);
     *pde = (pde_phyaddr | PG_US_U | PG_RW_W | PG_P_1);
     /* 分配到的物理页地址pde_phyaddr对应的物理内存清0,
      * 避免里面的旧数据变成页表项，从而让页表混乱
@@ -147,18 +168,20 @@ void* malloc_page(enum pool_flags pf, uint32_t pg_cnt){
    * 2. 通过palloc在物理内存池中申请物理页
    * 3. 通过page_table_add将以上得到的虚拟地址和物理地址在页表中完成映射
    * ********************************************************************/
+  struct pool* mem_pool = pf & PF_KERNEL ? &kernel_pool : &user_pool;
   void* vaddr_start = vaddr_get(pf,pg_cnt);
   if(vaddr_start == NULL){
+    mem_pool->alloc_fail++;
     return NULL;
   }
 
   uint32_t vaddr = (uint32_t)vaddr_start,cnt = pg_cnt;
-  struct pool* mem_pool = pf & PF_KERNEL ? &kernel_pool : &user_pool;
 
   /* 这里是因为虚拟地址是连续的，而物理地址不连续，所以逐个映射 */
   while(cnt-- >0){
     void* page_phyaddr = palloc(mem_pool);
     if(page_phyaddr == NULL){
+      mem_pool->alloc_fail++;
       return NULL;
     }
     page_table_add((void*)vaddr, page_phyaddr);     //做映射
@@ -170,19 +193,32 @@ void* malloc_page(enum pool_flags pf, uint32_t pg_cnt){
 /* 从内核物理内存池中申请1页内存 
  * 成功则返回其虚拟地址，失败则返回NULL*/
 void* get_kernel_pages(uint32_t pg_cnt){
+  lock_acquire(&kernel_pool.lock);
   void* vaddr = malloc_page(PF_KERNEL, pg_cnt);
+  lock_release(&kernel_pool.lock);
   if(vaddr != NULL){    //如果分配的地址不为空，则将页框清0后返回
     memset(vaddr, 0, pg_cnt * PG_SIZE);
+    MEMTRACE_ALLOC(vaddr, pg_cnt * PG_SIZE, __builtin_return_address(0));
   }
   return vaddr;
 }
 
+/* 释放get_kernel_pages得到的pg_cnt页，与sys_malloc等共用内核内存池，须持有其锁 */
+void free_kernel_pages(void* vaddr, uint32_t pg_cnt){
+  lock_acquire(&kernel_pool.lock);
+  mfree_page(PF_KERNEL, vaddr, pg_cnt);
+  lock_release(&kernel_pool.lock);
+}
+
 /* 在用户空间申请4K内存，并返回其虚拟地址 */
 void* get_user_pages(uint32_t pg_cnt){
   lock_acquire(&user_pool.lock);
   void* vaddr = malloc_page(PF_USER, pg_cnt);
-  memset(vaddr, 0, pg_cnt * PG_SIZE);
+  if(vaddr != NULL){
+    memset(vaddr, 0, pg_cnt * PG_SIZE);
+  }
   lock_release(&user_pool.lock);
+  MEMTRACE_ALLOC(vaddr, pg_cnt * PG_SIZE, __builtin_return_address(0));
   return vaddr;
 }
 
@@ -195,11 +231,11 @@ void* get_a_page(enum pool_flags pf, uint32_t vaddr){
   struct task_struct* cur = running_thread();
   int32_t bit_idx = -1;
   /* 若当前是用户进程申请用户内存，就修改用户进程自己的虚拟地址位图 */
-  if(cur->pgdir != NULL && pf == PF_USER){
-    bit_idx = (vaddr - cur->userprog_vaddr.vaddr_start)/PG_SIZE;
+  if(cur->mm != NULL && pf == PF_USER){
+    bit_idx = (vaddr - cur->mm->userprog_vaddr.vaddr_start)/PG_SIZE;
     ASSERT(bit_idx > 0);
-    bitmap_set(&cur->userprog_vaddr.vaddr_bitmap, bit_idx, 1);
-  }else if(cur->pgdir == NULL && pf == PF_KERNEL){
+    bitmap_set(&cur->mm->userprog_vaddr.vaddr_bitmap, bit_idx, 1);
+  }else if(cur->mm == NULL && pf == PF_KERNEL){
     /* 如果当前是内核线程申请内核内存，则修改kernel_vaddr */
     bit_idx = (vaddr - kernel_vaddr.vaddr_start)/PG_SIZE;
     ASSERT(bit_idx > 0);
@@ -210,6 +246,8 @@ void* get_a_page(enum pool_flags pf, uint32_t vaddr){
 
   void* page_phyaddr = palloc(mem_pool);
   if(page_phyaddr == NULL){
+    mem_pool->alloc_fail++;
+    lock_release(&mem_pool->lock);
     return NULL;
   }
   page_table_add((void*)vaddr, page_phyaddr);
@@ -283,6 +321,8 @@ static void mem_pool_init(uint32_t all_mem){    //这里的all_mem传递的参
 
   lock_init(&kernel_pool.lock);
   lock_init(&user_pool.lock);
+  kernel_pool.used_pages = user_pool.used_pages = 0;
+  kernel_pool.alloc_fail = user_pool.alloc_fail = 0;
   
   /* 下面初始化内核虚拟地址的位图，按照实际物理内存大小生成数组 */
   kernel_vaddr.vaddr_bitmap.btmp_bytes_len = kbm_length;         //用于维护内核堆的虚拟地址，所以要和内核内存池大小一致
@@ -298,17 +338,33 @@ static void mem_pool_init(uint32_t all_mem){    //这里的all_mem传递的参
 
 /* 为malloc做准备 */
 void block_desc_init(struct mem_block_desc* desc_array){
-  uint16_t desc_idx,block_size = 16;
+  uint16_t desc_idx;
   /* 初始化每个mem_block_desc描述符 */
   for(desc_idx = 0; desc_idx < DESC_CNT; desc_idx++){
-    desc_array[desc_idx].block_size = block_size;
+    desc_array[desc_idx].block_size = block_sizes[desc_idx];
     /* 初始化arena中的内存块数量 */
-    desc_array[desc_idx].blocks_per_arena = (PG_SIZE - sizeof(struct arena)) / block_size;
+    desc_array[desc_idx].blocks_per_arena = (PG_SIZE - sizeof(struct arena)) / block_sizes[desc_idx];
     list_init(&desc_array[desc_idx].free_list);
-    block_size *= 2;        //更新为下一个规格内存块
+    desc_array[desc_idx].arena_cnt = 0;
+    desc_array[desc_idx].free_cnt = 0;
   }
 }
 
+/* 生成size到规格下标的查找表，使sys_malloc匹配规格时不必逐个比较 */
+static void size_class_init(void){
+  uint32_t slot, desc_idx = 0;
+  for(slot = 0; slot < DIV_ROUND_UP(MAX_BLOCK_SIZE, 16); slot++){
+    /* 本槽对应的size范围是slot*16+1 ~ slot*16+16，取能容纳整个槽的最小规格，
+     * 只有最后一个槽的上限超过MAX_BLOCK_SIZE，超出部分由sys_malloc先行判断 */
+    while(block_sizes[desc_idx] < slot * 16 + 16 && desc_idx < DESC_CNT - 1){
+      desc_idx++;
+    }
+    size_class_idx[slot] = desc_idx;
+  }
+}
+
+static void* arena_page_alloc(enum pool_flags pf, uint32_t pg_cnt);
+
 /* 内存管理部分初始化入口 */
 void mem_init(){
   put_str("mem_init start\n");
@@ -316,6 +372,9 @@ void mem_init(){
   mem_pool_init(mem_bytes_total);
   /* 初始化mem_block_desc数组descs，为malloc做准备 */
   block_desc_init(k_block_descs);
+  size_class_init();
+  /* 初始化分配追踪表，默认关闭 */
+  memtrace_init();
   put_str("mem_init done\n");
 }
 
@@ -335,9 +394,10 @@ void* sys_malloc(uint32_t size){
   struct pool* mem_pool;
   uint32_t pool_size;
   struct mem_block_desc* descs;
+  void* caller = __builtin_return_address(0);   //记录调用者，供分配追踪使用
   struct task_struct* cur_thread = running_thread();
   /* 判断使用哪个内存池 */
-  if(cur_thread->pgdir == NULL){    //若为内核线程
+  if(cur_thread->mm == NULL){    //若为内核线程
     PF = PF_KERNEL;
     pool_size = kernel_pool.pool_size;
     mem_pool = &kernel_pool;
@@ -346,7 +406,7 @@ void* sys_malloc(uint32_t size){
     PF = PF_USER;
     pool_size = user_pool.pool_size;
     mem_pool = &user_pool;
-    descs = cur_thread->u_block_desc;
+    descs = cur_thread->mm->u_block_desc;
   }
 
   /* 若申请的内存不再内存池容量范围内，则直接返回NULL */
@@ -357,9 +417,16 @@ void* sys_malloc(uint32_t size){
   struct mem_block* b;
   lock_acquire(&mem_pool->lock);
   /* 超过最大内存块，就分配页框 */
-  if(size > 1024){
+  if(size > MAX_BLOCK_SIZE){
     uint32_t page_cnt = DIV_ROUND_UP(size + sizeof(struct arena), PG_SIZE);     //向上取整需要的页框数
-    a = malloc_page(PF, page_cnt);
+    a = NULL;
+    /* 内核线程优先复用缓存中页数相同的arena */
+    if(PF == PF_KERNEL && page_cnt <= LARGE_CACHE_PAGES && large_cache_cnt[page_cnt - 1] > 0){
+      a = large_cache[page_cnt - 1][--large_cache_cnt[page_cnt - 1]];
+      large_cache_hits++;
+    }else{
+      a = arena_page_alloc(PF, page_cnt);
+    }
     if(a != NULL){
       memset(a, 0, page_cnt * PG_SIZE);     //将分配的内存清0
       /* 对于分配的大块页框，将desc置为NULL,
@@ -368,23 +435,20 @@ void* sys_malloc(uint32_t size){
       a->cnt = page_cnt;
       a->large = true;
       lock_release(&mem_pool->lock);
+      MEMTRACE_ALLOC(a + 1, size, caller);
       return (void*)(a + 1);  //跨过arena大小，把剩下的内存返回
     }else{
       lock_release(&mem_pool->lock);
       return NULL;
     }
-  }else{    //若申请的内存小于等于1024,则可在各种规格的mem_block_desc中去适配
-    uint8_t desc_idx;
-    /* 从哦你内存块描述符中匹配合适的内存块规格 */
-    for(desc_idx = 0; desc_idx < DESC_CNT; desc_idx++){
-      if(size <= descs[desc_idx].block_size){
-        break;          //从小往大找
-      }
-    }
+  }else{    //若申请的内存不超过MAX_BLOCK_SIZE,则可在各种规格的mem_block_desc中去适配
+    /* 查表得到能容纳size的最小规格 */
+    uint8_t desc_idx = size_class_idx[(size - 1) >> 4];
+    ASSERT(size <= descs[desc_idx].block_size);
     /* 若mem_block_desc的free_list中已经没有可用的mem_block,
      * 就创建新的arena提供mem_block */
     if(list_empty(&descs[desc_idx].free_list)){
-      a = malloc_page(PF, 1);       //分配1页框作为arena
+      a = arena_page_alloc(PF, 1);       //分配1页框作为arena
       if(a == NULL){
         lock_release(&mem_pool->lock);
         return NULL;
@@ -395,12 +459,14 @@ void* sys_malloc(uint32_t size){
       a->desc = &descs[desc_idx];
       a->large = false;
       a->cnt = descs[desc_idx].blocks_per_arena;
+      descs[desc_idx].arena_cnt++;
+      descs[desc_idx].free_cnt += descs[desc_idx].blocks_per_arena;
       uint32_t block_idx;
       enum intr_status old_status = intr_disable();
       /* 开始将arena拆分成内存块，并添加到内存块描述符的free_list当中 */
       for(block_idx = 0; block_idx < descs[desc_idx].blocks_per_arena; block_idx++){
         b = arena2block(a, block_idx);
-        ASSERT(!elem_find(&a->desc->free_list, &b->free_elem));
+        ASSERT(!elem_on_list(&a->desc->free_list, &b->free_elem));
         list_append(&a->desc->free_list, &b->free_elem);
       }
       intr_set_status(old_status);
@@ -410,7 +476,9 @@ void* sys_malloc(uint32_t size){
     memset(b, 0, descs[desc_idx].block_size);
     a = block2arena(b);     //获取所在arena
     a->cnt--;
+    descs[desc_idx].free_cnt--;
     lock_release(&mem_pool->lock);
+    MEMTRACE_ALLOC(b, size, caller);
     return (void*)b;
   }
 }
@@ -427,6 +495,7 @@ void pfree(uint32_t pg_phy_addr){
     bit_idx = (pg_phy_addr - kernel_pool.phy_addr_start) / PG_SIZE;
   }
   bitmap_set(&mem_pool->pool_bitmap, bit_idx, 0);
+  mem_pool->used_pages--;
 }
 
 /* 去掉页表中虚拟地址vaddr的映射，只用去掉vaddr对应的pte */
@@ -446,9 +515,9 @@ static void vaddr_remove(enum pool_flags pf, void* _vaddr, uint32_t pg_cnt){
     }
   }else{
     struct task_struct* cur_thread = running_thread();
-    bit_idx_start = (vaddr - cur_thread->userprog_vaddr.vaddr_start) / PG_SIZE;
+    bit_idx_start = (vaddr - cur_thread->mm->userprog_vaddr.vaddr_start) / PG_SIZE;
     while(cnt < pg_cnt){
-      bitmap_set(&cur_thread->userprog_vaddr.vaddr_bitmap, bit_idx_start + cnt++, 0);
+      bitmap_set(&cur_thread->mm->userprog_vaddr.vaddr_bitmap, bit_idx_start + cnt++, 0);
     }
   }
 }
@@ -458,6 +527,7 @@ void mfree_page(enum pool_flags pf, void* _vaddr, uint32_t pg_cnt){
   uint32_t pg_phy_addr;
   uint32_t vaddr = (int32_t)_vaddr, page_cnt = 0;
   ASSERT(pg_cnt >= 1 && vaddr % PG_SIZE == 0);
+  MEMTRACE_FREE(_vaddr);
   pg_phy_addr = addr_v2p(vaddr);    //获取虚拟地址vaddr对应的物理地址
   
   /* 确保待释放的物理内存在低端1MB + 1KB大小的页目录 + 1KB大小的页表地址范围外 */
@@ -479,6 +549,10 @@ void mfree_page(enum pool_flags pf, void* _vaddr, uint32_t pg_cnt){
     }
   /* 清空虚拟地址位图中的相应位 */
     vaddr_remove(pf, _vaddr, pg_cnt);
+    /* 同一进程的其他线程可能正在其他CPU上运行，它们的TLB中可能还缓存着这些页 */
+    if(running_thread()->mm->users > 1){
+      smp_flush_tlb_others();
+    }
   }else{
     vaddr -= PG_SIZE;
     while(page_cnt < pg_cnt){
@@ -494,6 +568,84 @@ void mfree_page(enum pool_flags pf, void* _vaddr, uint32_t pg_cnt){
     }
     /* 清空虚拟地址位图中的相应位 */
     vaddr_remove(pf, _vaddr, pg_cnt);
+    /* 内核空间为所有CPU共享，其他CPU的TLB中可能还缓存着这些页 */
+    smp_flush_tlb_others();
+  }
+}
+
+/* 在当前进程的用户空间申请pg_cnt页作为线程栈，其下多占一页虚拟地址作为保护页，
+ * 保护页不映射，栈溢出时引发缺页异常而不会写坏相邻的内存。返回保护页的地址，失败返回NULL */
+void* get_user_stack(uint32_t pg_cnt){
+  lock_acquire(&user_pool.lock);
+  void* guard = malloc_page(PF_USER, pg_cnt + 1);
+  if(guard != NULL){
+    pfree(addr_v2p((uint32_t)guard));
+    page_table_pte_remove((uint32_t)guard);     //虚拟地址仍留在位图中，不会分给别人
+    memset((void*)((uint32_t)guard + PG_SIZE), 0, pg_cnt * PG_SIZE);
+  }
+  lock_release(&user_pool.lock);
+  if(guard != NULL){
+    MEMTRACE_ALLOC((void*)((uint32_t)guard + PG_SIZE), pg_cnt * PG_SIZE, __builtin_return_address(0));
+  }
+  return guard;
+}
+
+/* 释放get_user_stack得到的栈，guard为其保护页 */
+void free_user_stack(void* guard, uint32_t pg_cnt){
+  lock_acquire(&user_pool.lock);
+  mfree_page(PF_USER, (void*)((uint32_t)guard + PG_SIZE), pg_cnt);
+  vaddr_remove(PF_USER, guard, 1);
+  lock_release(&user_pool.lock);
+}
+
+/* 把设备寄存器所在的物理页paddr以禁止缓存的方式映射到内核虚拟地址vaddr，
+ * vaddr不在内核虚拟地址池中，需在创建用户进程之前调用，以便其页目录项能被复制过去 */
+void mmio_map(uint32_t vaddr, uint32_t paddr){
+  ASSERT(vaddr >= 0xc0000000 && vaddr % PG_SIZE == 0 && paddr % PG_SIZE == 0);
+  lock_acquire(&kernel_pool.lock);
+  page_table_add((void*)vaddr, (void*)paddr);
+  *pte_ptr(vaddr) |= PG_PCD | PG_PWT;
+  asm volatile ("invlpg %0" : : "m"(*(char*)vaddr) : "memory");
+  lock_release(&kernel_pool.lock);
+}
+
+/* 把物理页paddr以只读方式映射到当前进程的用户虚拟地址vaddr，供内核与用户共享数据，
+ * vaddr不在进程的虚拟地址池中，进程的所有线程共享此映射 */
+void user_map_ro(uint32_t vaddr, uint32_t paddr){
+  ASSERT(running_thread()->mm != NULL);
+  ASSERT(vaddr < 0xc0000000 && vaddr % PG_SIZE == 0 && paddr % PG_SIZE == 0);
+  lock_acquire(&kernel_pool.lock);      //页表所在的页框从内核内存池中分配
+  page_table_add((void*)vaddr, (void*)paddr);
+  *pte_ptr(vaddr) &= ~PG_RW_W;
+  asm volatile ("invlpg %0" : : "m"(*(char*)vaddr) : "memory");
+  lock_release(&kernel_pool.lock);
+}
+
+/* 释放当前页目录中用户空间的全部映射，连同映射的物理页框和页表本身，
+ * 在进程的最后一个使用者退出时调用，此时已没有线程会访问这些内存。
+ * user_map_ro映射的内核页不属于本进程，只解除映射 */
+void user_space_free(void){
+  uint32_t pde_idx = 0;
+  while(pde_idx < 0x300){       //第768项起是共享的内核空间
+    uint32_t* pde = (uint32_t*)(0xfffff000 + pde_idx*4);
+    if(*pde & PG_P_1){
+      uint32_t* pte = (uint32_t*)(0xffc00000 + pde_idx*PG_SIZE);
+      uint32_t pte_idx = 0;
+      lock_acquire(&user_pool.lock);
+      while(pte_idx < 1024){
+        uint32_t pg_phy_addr = pte[pte_idx] & 0xfffff000;
+        if((pte[pte_idx] & PG_P_1) && pg_phy_addr >= user_pool.phy_addr_start){
+          pfree(pg_phy_addr);
+        }
+        pte_idx++;
+      }
+      lock_release(&user_pool.lock);
+      lock_acquire(&kernel_pool.lock);  //页表所在的页框从内核内存池中分配
+      pfree(*pde & 0xfffff000);
+      lock_release(&kernel_pool.lock);
+      *pde = 0;
+    }
+    pde_idx++;
   }
 }
 
@@ -501,11 +653,12 @@ void mfree_page(enum pool_flags pf, void* _vaddr, uint32_t pg_cnt){
 void sys_free(void* ptr){
   ASSERT(ptr != NULL);
   if(ptr != NULL){
+    MEMTRACE_FREE(ptr);
     enum pool_flags PF;
     struct pool* mem_pool;
 
     /* 判断是线程还是进程 */
-    if(running_thread()->pgdir == NULL){
+    if(running_thread()->mm == NULL){
       ASSERT((uint32_t)ptr > K_HEAP_START);
       PF = PF_KERNEL;
       mem_pool = &kernel_pool;
@@ -519,17 +672,25 @@ void sys_free(void* ptr){
     struct arena* a = block2arena(b);
     //把mem_block换成arena，获取元信息
     ASSERT(a->large == 0 || a->large == 1);
-    if(a->desc == NULL && a->large == true){    //大于1024的内存
-      mfree_page(PF, a, a->cnt);
-    }else{                                      //小于1024的内存
+    if(a->desc == NULL && a->large == true){    //大于MAX_BLOCK_SIZE的内存
+      /* 内核的小页数arena先放入缓存，缓存满时才真正释放 */
+      if(PF == PF_KERNEL && a->cnt <= LARGE_CACHE_PAGES && large_cache_cnt[a->cnt - 1] < LARGE_CACHE_DEPTH){
+        large_cache[a->cnt - 1][large_cache_cnt[a->cnt - 1]++] = a;
+      }else{
+        mfree_page(PF, a, a->cnt);
+      }
+    }else{                                      //不超过MAX_BLOCK_SIZE的内存
       /* 先将内存块回收到free_list */
       list_append(&a->desc->free_list, &b->free_elem);
+      a->desc->free_cnt++;
       /* 再判断arena中的块是否都空闲，若是则收回整个块 */
       if(++a->cnt == a->desc->blocks_per_arena){
+        a->desc->arena_cnt--;
+        a->desc->free_cnt -= a->desc->blocks_per_arena;
         uint32_t block_idx;
         for(block_idx = 0; block_idx < a->desc->blocks_per_arena; block_idx++){
           struct mem_block* b = arena2block(a, block_idx);
-          ASSERT(elem_find(&a->desc->free_list, &b->free_elem));
+          ASSERT(elem_on_list(&a->desc->free_list, &b->free_elem));
           list_remove(&b->free_elem);
         }
         mfree_page(PF, a, 1);
@@ -537,4 +698,105 @@ void sys_free(void* ptr){
     }
     lock_release(&mem_pool->lock);
   }
-}
\ No newline at end of file
+}
+
+/* 释放大块arena缓存中的全部页框，返回释放的页框数，调用者需持有kernel_pool.lock */
+static uint32_t large_cache_drain(void){
+  uint32_t pg_cnt, freed = 0;
+  for(pg_cnt = 1; pg_cnt <= LARGE_CACHE_PAGES; pg_cnt++){
+    while(large_cache_cnt[pg_cnt - 1] > 0){
+      mfree_page(PF_KERNEL, large_cache[pg_cnt - 1][--large_cache_cnt[pg_cnt - 1]], pg_cnt);
+      freed += pg_cnt;
+    }
+  }
+  return freed;
+}
+
+/* 分配pg_cnt页作为arena，内核池分配失败时先清空大块缓存再试一次 */
+static void* arena_page_alloc(enum pool_flags pf, uint32_t pg_cnt){
+  void* a = malloc_page(pf, pg_cnt);
+  if(a == NULL && pf == PF_KERNEL && large_cache_drain() > 0){
+    a = malloc_page(pf, pg_cnt);
+  }
+  return a;
+}
+
+/* 填充物理内存池m_pool的统计信息 */
+static void pool_stat_get(struct pool* m_pool, struct pool_stat* ps){
+  lock_acquire(&m_pool->lock);
+  ps->total_pages = m_pool->pool_bitmap.btmp_bytes_len * 8;
+  ps->used_pages = m_pool->used_pages;
+  ps->free_pages = ps->total_pages - ps->used_pages;
+  ps->max_free_run = bitmap_max_free_run(&m_pool->pool_bitmap, NULL);
+  ps->alloc_fail = m_pool->alloc_fail;
+  lock_release(&m_pool->lock);
+}
+
+/* 获取内存统计快照，规格和虚拟地址部分针对当前任务 */
+void mem_stats_get(struct mem_stats* stats){
+  struct task_struct* cur = running_thread();
+  struct mem_block_desc* descs;
+  struct virtual_addr* vaddr;
+  struct pool* mem_pool;
+  if(cur->mm == NULL){
+    descs = k_block_descs;
+    vaddr = &kernel_vaddr;
+    mem_pool = &kernel_pool;
+  }else{
+    descs = cur->mm->u_block_desc;
+    vaddr = &cur->mm->userprog_vaddr;
+    mem_pool = &user_pool;
+  }
+  pool_stat_get(&kernel_pool, &stats->kernel);
+  pool_stat_get(&user_pool, &stats->user);
+
+  /* 规格统计和虚拟地址位图都在内存池锁的保护下修改 */
+  lock_acquire(&mem_pool->lock);
+  stats->vaddr_max_free_run = bitmap_max_free_run(&vaddr->vaddr_bitmap, &stats->vaddr_free_pages);
+  uint32_t desc_idx;
+  for(desc_idx = 0; desc_idx < DESC_CNT; desc_idx++){
+    stats->classes[desc_idx].block_size = descs[desc_idx].block_size;
+    stats->classes[desc_idx].arena_cnt = descs[desc_idx].arena_cnt;
+    stats->classes[desc_idx].free_blocks = descs[desc_idx].free_cnt;
+  }
+  lock_release(&mem_pool->lock);
+
+  lock_acquire(&kernel_pool.lock);
+  stats->large_cached_pages = 0;
+  for(desc_idx = 0; desc_idx < LARGE_CACHE_PAGES; desc_idx++){
+    stats->large_cached_pages += large_cache_cnt[desc_idx] * (desc_idx + 1);
+  }
+  stats->large_cache_hits = large_cache_hits;
+  lock_release(&kernel_pool.lock);
+}
+
+/* 系统调用memstat，将统计快照写入用户提供的缓冲区 */
+int32_t sys_memstat(struct mem_stats* stats){
+  if(stats == NULL){
+    return -1;
+  }
+  mem_stats_get(stats);
+  return 0;
+}
+
+/* 打印物理内存池统计 */
+static void pool_stat_dump(char* name, struct pool_stat* ps){
+  printk("  %s pool: total:%d used:%d free:%d max_free_run:%d fail:%d\n", \
+      name, ps->total_pages, ps->used_pages, ps->free_pages, ps->max_free_run, ps->alloc_fail);
+}
+
+/* 在终端输出当前内存统计，供内核调试使用 */
+void mem_stats_dump(void){
+  struct mem_stats stats;
+  mem_stats_get(&stats);
+  printk("mem stats:\n");
+  pool_stat_dump("kernel", &stats.kernel);
+  pool_stat_dump("user", &stats.user);
+  printk("  vaddr: free:%d max_free_run:%d\n", stats.vaddr_free_pages, stats.vaddr_max_free_run);
+  uint32_t desc_idx;
+  for(desc_idx = 0; desc_idx < DESC_CNT; desc_idx++){
+    printk("  class %d: arenas:%d free_blocks:%d\n", stats.classes[desc_idx].block_size, \
+        stats.classes[desc_idx].arena_cnt, stats.classes[desc_idx].free_blocks);
+  }
+  printk("  large cache: pages:%d hits:%d\n", stats.large_cached_pages, stats.large_cache_hits);
+}
@@ -19,6 +19,8 @@ enum pool_flags{
 #define PG_RW_W 2   //R/W属性位值，读/写/执行
 #define PG_US_S 0   //U/S属性位值，系统级
 #define PG_US_U 4   //U/S属性位值，用户级
+#define PG_PWT 8    //PWT属性位，直写
+#define PG_PCD 16   //PCD属性位，禁止缓存，用于映射设备寄存器
 /* 虚拟地址池，用于虚拟地址管理 */
 struct virtual_addr {
   struct bitmap vaddr_bitmap;
@@ -35,20 +37,64 @@ struct mem_block_desc{
   uint32_t block_size;  //内存块大小
   uint32_t blocks_per_arena;    //本arena中可容纳此mem_block的数量
   struct list free_list;        //目前可用的mem_block链表
+  uint32_t arena_cnt;           //此规格当前持有的arena数量
+  uint32_t free_cnt;            //free_list中空闲mem_block的数量
 };
 
-#define DESC_CNT 7              //内存块描述符个数，这里我们实现了16,32,64,128,256,512,1024字节这几种规格
+/* 内存块描述符个数，规格为16,32,48,64,96,128,192,256,384,512,768,1024,1360,2040字节，
+ * 在2的幂之间插入1.5倍的规格以减少内部碎片，
+ * 1360和2040分别是一页arena恰好容纳3块和2块时的最大规格（8字节对齐） */
+#define DESC_CNT 14
+#define MAX_BLOCK_SIZE 2040     //最大的内存块规格，超过此大小直接分配页框
+#define LARGE_CACHE_PAGES 4     //缓存1～4页的已释放大块arena
+#define LARGE_CACHE_DEPTH 4     //每种页数最多缓存的arena个数
+
+/* 物理内存池的统计信息 */
+struct pool_stat{
+  uint32_t total_pages;         //内存池总页框数
+  uint32_t used_pages;          //已分配的页框数
+  uint32_t free_pages;          //空闲页框数
+  uint32_t max_free_run;        //最长连续空闲页框数，用于衡量碎片程度
+  uint32_t alloc_fail;          //分配失败次数
+};
+
+/* 某一规格内存块的统计信息 */
+struct class_stat{
+  uint32_t block_size;          //内存块大小
+  uint32_t arena_cnt;           //持有的arena数量
+  uint32_t free_blocks;         //空闲内存块数量
+};
+
+/* 内存统计快照，由sys_memstat拷贝给用户 */
+struct mem_stats{
+  struct pool_stat kernel;      //内核物理内存池
+  struct pool_stat user;        //用户物理内存池
+  uint32_t vaddr_free_pages;    //当前任务虚拟地址池中的空闲页数
+  uint32_t vaddr_max_free_run;  //当前任务虚拟地址池中最长连续空闲页数
+  struct class_stat classes[DESC_CNT];  //当前任务各规格内存块，内核线程为k_block_descs
+  uint32_t large_cached_pages;  //内核大块arena缓存中占用的页框数
+  uint32_t large_cache_hits;    //大块分配命中缓存的次数
+};
 
 extern struct pool kernel_pool, user_pool;
 void mem_init(void);
 void* malloc_page(enum pool_flags pf, uint32_t pg_cnt);
 void* get_kernel_pages(uint32_t pg_cnt);
+void free_kernel_pages(void* vaddr, uint32_t pg_cnt);
 void* get_user_pages(uint32_t pg_cnt);
+void* get_user_stack(uint32_t pg_cnt);
+void free_user_stack(void* guard, uint32_t pg_cnt);
 void* get_a_page(enum pool_flags pf, uint32_t vaddr);
 uint32_t addr_v2p(uint32_t vaddr);
 void block_desc_init(struct mem_block_desc* desc_array);
 void* sys_malloc(uint32_t size);
 void pfree(uint32_t pg_phy_addr);
 void mfree_page(enum pool_flags pf, void* _vaddr, uint32_t pg_cnt);
+void mmio_map(uint32_t vaddr, uint32_t paddr);
+void user_map_ro(uint32_t vaddr, uint32_t paddr);
+void user_space_free(void);
 void sys_free(void* ptr);
+void mem_stats_get(struct mem_stats* stats);
+int32_t sys_memstat(struct mem_stats* stats);
+void mem_stats_dump(void);
 #endif
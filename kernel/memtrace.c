@@ -0,0 +1,208 @@
+#include "memtrace.h"
+#include "stdint.h"
+#include "global.h"
+#include "interrupt.h"
+#include "thread.h"
+#include "timer.h"
+#include "stdio-kernel.h"
+#include "spinlock.h"
+
+uint32_t memtrace_sample_rate = 0;      //默认关闭
+uint32_t memtrace_live = 0;
+
+static struct memtrace_record records[MEMTRACE_MAX_RECORDS];    //记录池
+static int16_t buckets[MEMTRACE_BUCKETS];   //哈希桶，存放链首记录下标
+static int16_t free_head;                   //空闲记录链表头
+static uint32_t sample_cnt;                 //采样计数
+static uint32_t dropped;                    //记录池满而丢弃的次数
+static struct spinlock memtrace_lock;       //多个CPU间保护记录表
+
+/* 按调用者汇总的统计项，仅在生成报告时使用 */
+struct caller_stat{
+  void* caller;
+  uint32_t bytes;
+  uint32_t cnt;
+};
+
+/* 计算ptr所在的哈希桶。arena中的块紧跟在12字节的arena头之后，块大小都是16的倍数，
+ * 整页分配则按页对齐，同类地址的低4位总是相同，不含信息，故先去掉 */
+static uint32_t ptr_hash(void* ptr){
+  return (((uint32_t)ptr >> 4) * 2654435761u) >> (32 - MEMTRACE_HASH_BITS);
+}
+
+/* 初始化追踪表，所有记录串入空闲链表 */
+void memtrace_init(void){
+  uint32_t idx;
+  for(idx = 0; idx < MEMTRACE_BUCKETS; idx++){
+    buckets[idx] = MEMTRACE_NIL;
+  }
+  for(idx = 0; idx < MEMTRACE_MAX_RECORDS; idx++){
+    records[idx].ptr = NULL;
+    records[idx].next = (idx + 1 < MEMTRACE_MAX_RECORDS) ? (int16_t)(idx + 1) : MEMTRACE_NIL;
+  }
+  free_head = 0;
+  sample_cnt = dropped = 0;
+  spin_lock_init(&memtrace_lock);
+  memtrace_live = 0;
+  memtrace_sample_rate = 0;
+}
+
+/* 开启追踪，每sample_rate次分配记录1次 */
+void memtrace_enable(uint32_t sample_rate){
+  memtrace_sample_rate = sample_rate;
+}
+
+/* 关闭追踪，已有记录保留，直到对应内存被释放 */
+void memtrace_disable(void){
+  memtrace_sample_rate = 0;
+}
+
+/* 记录一次分配 */
+void memtrace_alloc(void* ptr, uint32_t size, void* caller){
+  if(ptr == NULL || memtrace_sample_rate == 0){
+    return;
+  }
+  enum intr_status old_status = spin_lock_irqsave(&memtrace_lock);
+  if(sample_cnt++ % memtrace_sample_rate != 0){
+    spin_unlock_irqrestore(&memtrace_lock, old_status);
+    return;
+  }
+  if(free_head == MEMTRACE_NIL){    //记录池已满
+    dropped++;
+    spin_unlock_irqrestore(&memtrace_lock, old_status);
+    return;
+  }
+  int16_t idx = free_head;
+  struct memtrace_record* rec = &records[idx];
+  free_head = rec->next;
+  rec->ptr = ptr;
+  rec->caller = caller;
+  rec->size = size;
+  rec->tick = ticks;
+  rec->pid = running_thread()->pid;
+  /* 插入哈希链表头部 */
+  uint32_t bucket = ptr_hash(ptr);
+  rec->next = buckets[bucket];
+  buckets[bucket] = idx;
+  memtrace_live++;
+  spin_unlock_irqrestore(&memtrace_lock, old_status);
+}
+
+/* 删除ptr对应的记录，未被采样的地址直接忽略 */
+void memtrace_free(void* ptr){
+  enum intr_status old_status = spin_lock_irqsave(&memtrace_lock);
+  int16_t* link = &buckets[ptr_hash(ptr)];
+  while(*link != MEMTRACE_NIL){
+    struct memtrace_record* rec = &records[*link];
+    if(rec->ptr == ptr){
+      int16_t idx = *link;
+      *link = rec->next;
+      rec->ptr = NULL;
+      rec->next = free_head;
+      free_head = idx;
+      memtrace_live--;
+      break;
+    }
+    link = &rec->next;
+  }
+  spin_unlock_irqrestore(&memtrace_lock, old_status);
+}
+
+/* 将存活记录按调用者汇总到stats中，返回不同调用者的个数 */
+static uint32_t collect_callers(struct caller_stat* stats){
+  uint32_t stat_cnt = 0, idx, s;
+  for(idx = 0; idx < MEMTRACE_MAX_RECORDS; idx++){
+    struct memtrace_record* rec = &records[idx];
+    if(rec->ptr == NULL){
+      continue;
+    }
+    for(s = 0; s < stat_cnt; s++){
+      if(stats[s].caller == rec->caller){
+        break;
+      }
+    }
+    if(s == stat_cnt){
+      if(stat_cnt == MEMTRACE_MAX_CALLERS){   //调用者过多，余下的不再单独统计
+        continue;
+      }
+      stats[s].caller = rec->caller;
+      stats[s].bytes = stats[s].cnt = 0;
+      stat_cnt++;
+    }
+    stats[s].bytes += rec->size;
+    stats[s].cnt++;
+  }
+  return stat_cnt;
+}
+
+/* 打印前MEMTRACE_TOP_N名调用者，by_bytes为true时按字节数排序，否则按次数 */
+static void print_top(struct caller_stat* stats, uint32_t stat_cnt, bool by_bytes){
+  uint32_t rank, s;
+  bool taken[MEMTRACE_MAX_CALLERS] = {0};
+  for(rank = 0; rank < MEMTRACE_TOP_N && rank < stat_cnt; rank++){
+    int32_t best = -1;
+    for(s = 0; s < stat_cnt; s++){
+      if(taken[s]){
+        continue;
+      }
+      uint32_t key = by_bytes ? stats[s].bytes : stats[s].cnt;
+      uint32_t best_key = best < 0 ? 0 : (by_bytes ? stats[best].bytes : stats[best].cnt);
+      if(best < 0 || key > best_key){
+        best = s;
+      }
+    }
+    taken[best] = true;
+    printk("    caller:0x%x bytes:%d cnt:%d\n", (uint32_t)stats[best].caller, stats[best].bytes, stats[best].cnt);
+  }
+}
+
+/* 输出追踪报告：按字节数和次数的前几名调用者，以及存活超过older_than_ticks的分配 */
+void memtrace_report(uint32_t older_than_ticks){
+  struct caller_stat stats[MEMTRACE_MAX_CALLERS];
+  struct memtrace_record old[MEMTRACE_TOP_N];
+  uint32_t old_cnt = 0, idx, live, lost;
+
+  /* 持锁拷贝一份快照，打印时会申请终端锁，不能在关中断时进行 */
+  enum intr_status old_status = spin_lock_irqsave(&memtrace_lock);
+  uint32_t stat_cnt = collect_callers(stats);
+  uint32_t now = ticks;
+  for(idx = 0; idx < MEMTRACE_MAX_RECORDS && old_cnt < MEMTRACE_TOP_N; idx++){
+    if(records[idx].ptr != NULL && now - records[idx].tick >= older_than_ticks){
+      old[old_cnt++] = records[idx];
+    }
+  }
+  live = memtrace_live;
+  lost = dropped;
+  spin_unlock_irqrestore(&memtrace_lock, old_status);
+
+  printk("memtrace: live:%d dropped:%d sample_rate:%d\n", live, lost, memtrace_sample_rate);
+  printk("  top callers by bytes:\n");
+  print_top(stats, stat_cnt, true);
+  printk("  top callers by count:\n");
+  print_top(stats, stat_cnt, false);
+  printk("  allocations older than %d ticks:\n", older_than_ticks);
+  for(idx = 0; idx < old_cnt; idx++){
+    printk("    ptr:0x%x size:%d caller:0x%x pid:%d age:%d\n", (uint32_t)old[idx].ptr, old[idx].size, \
+        (uint32_t)old[idx].caller, old[idx].pid, now - old[idx].tick);
+  }
+}
+
+/* 系统调用memtrace，运行时开关采样或输出报告，成功返回0，命令无效返回-1 */
+int32_t sys_memtrace(uint32_t cmd, uint32_t arg){
+  switch(cmd){
+    case MEMTRACE_CMD_ENABLE:
+      if(arg == 0){
+        return -1;
+      }
+      memtrace_enable(arg);
+      return 0;
+    case MEMTRACE_CMD_DISABLE:
+      memtrace_disable();
+      return 0;
+    case MEMTRACE_CMD_REPORT:
+      memtrace_report(arg);
+      return 0;
+    default:
+      return -1;
+  }
+}
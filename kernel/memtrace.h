@@ -0,0 +1,50 @@
+#ifndef __KERNEL_MEMTRACE_H
+#define __KERNEL_MEMTRACE_H
+#include "stdint.h"
+#include "global.h"
+
+#define MEMTRACE_HASH_BITS 8                        //哈希表位数
+#define MEMTRACE_BUCKETS (1 << MEMTRACE_HASH_BITS)  //哈希桶个数
+#define MEMTRACE_MAX_RECORDS 512                    //最多同时记录的存活分配数
+#define MEMTRACE_MAX_CALLERS 64                     //报告时最多统计的不同调用者数
+#define MEMTRACE_TOP_N 8                            //报告中列出前几名
+#define MEMTRACE_NIL (-1)                           //哈希链结束标记
+
+/* 一条存活分配的记录，保持紧凑，每条20字节 */
+struct memtrace_record{
+  void* ptr;            //分配得到的地址，NULL表示此记录空闲
+  void* caller;         //调用者的返回地址
+  uint32_t size;        //申请的字节数
+  uint32_t tick;        //分配时的ticks
+  int16_t pid;          //发起分配的线程pid
+  int16_t next;         //哈希链或空闲链中下一条记录的下标
+};
+
+/* 采样间隔，0表示关闭追踪，1表示记录每次分配，N表示每N次分配记录1次 */
+extern uint32_t memtrace_sample_rate;
+/* 表中当前存活的记录数，为0时释放路径无需查表 */
+extern uint32_t memtrace_live;
+
+/* 分配/释放路径上的挂钩，关闭追踪时只有一次比较的开销 */
+#define MEMTRACE_ALLOC(PTR, SIZE, CALLER) do{ \
+  if(memtrace_sample_rate != 0){ memtrace_alloc(PTR, SIZE, CALLER); } \
+}while(0)
+#define MEMTRACE_FREE(PTR) do{ \
+  if(memtrace_live != 0){ memtrace_free(PTR); } \
+}while(0)
+
+/* 系统调用memtrace的命令 */
+enum memtrace_cmd{
+  MEMTRACE_CMD_ENABLE,      //arg为采样间隔
+  MEMTRACE_CMD_DISABLE,
+  MEMTRACE_CMD_REPORT       //arg为报告中长期存活分配的最短存活ticks
+};
+
+void memtrace_init(void);
+void memtrace_enable(uint32_t sample_rate);
+void memtrace_disable(void);
+void memtrace_alloc(void* ptr, uint32_t size, void* caller);
+void memtrace_free(void* ptr);
+void memtrace_report(uint32_t older_than_ticks);
+int32_t sys_memtrace(uint32_t cmd, uint32_t arg);
+#endif
@@ -0,0 +1,193 @@
+#include "smp.h"
+#include "stdint.h"
+#include "global.h"
+#include "string.h"
+#include "thread.h"
+#include "memory.h"
+#include "interrupt.h"
+#include "lapic.h"
+#include "tss.h"
+#include "timer.h"
+#include "spinlock.h"
+#include "debug.h"
+#include "print.h"
+#include "fpu.h"
+#include "syscall-init.h"
+
+#define AP_TRAMPOLINE_PADDR 0x90000     //AP启动代码的物理地址，须与trampoline.S一致
+#define AP_ARRIVE_TICKS 5               //等待AP领取编号的时间
+#define AP_BOOT_WAIT_TICKS 20           //等待AP启动的最长时间
+
+struct cpu cpus[MAX_CPUS];
+uint8_t cpu_cnt;
+
+/* trampoline.S中BSP与AP交换参数的区域 */
+struct ap_mailbox{
+  uint32_t entry;
+  uint32_t cpu_limit;
+  volatile uint32_t next_id;
+  uint32_t stacks[MAX_CPUS];
+};
+
+extern char ap_trampoline_start[], ap_trampoline_end[], ap_mailbox[];
+
+/* 在thread_init之前调用，只登记BSP */
+void smp_early_init(void){
+  memset(cpus, 0, sizeof(cpus));
+  uint8_t id;
+  for(id = 0; id < MAX_CPUS; id++){
+    cpus[id].id = id;
+  }
+  cpus[0].online = true;
+  cpu_cnt = 1;
+}
+
+/* 刷新本CPU的全部TLB */
+static void local_flush_tlb(void){
+  uint32_t cr3;
+  asm volatile ("movl %%cr3, %0; movl %0, %%cr3" : "=r"(cr3) : : "memory");
+}
+
+/* 被唤醒的idle会在循环中重新调度，这里只需结束中断 */
+static void intr_resched_handler(void){
+  lapic_eoi();      //need_resched由intr_exit检查
+}
+
+/* 其他CPU要求刷新TLB */
+static void intr_tlb_flush_handler(void){
+  struct cpu* self = this_cpu();
+  if(self->tlb_flush_pending){
+    local_flush_tlb();
+    self->tlb_flush_pending = 0;
+  }
+  lapic_eoi();
+}
+
+/* AP从trampoline进入此处，已开启分页，栈位于本CPU的idle线程页中 */
+void ap_main(uint32_t id){
+  struct task_struct* idle = running_thread();
+  ASSERT(idle == cpus[id].idle && idle->cpu == id);
+  tss_load(id);
+  idt_load();
+  fpu_ap_init();
+  syscall_ap_init();
+  lapic_ap_init();
+  cpus[id].apic_id = lapic_id();
+  cpus[id].curr = idle;
+  thread_all_list_add(idle);
+  cpus[id].online = true;
+  intr_enable();
+  cpu_idle();
+}
+
+/* 若cpu正在运行idle线程，发送IPI把它从hlt中唤醒，使其尽快调度新放入的线程 */
+void smp_resched(uint8_t cpu){
+  struct cpu* target = &cpus[cpu];
+  if(cpu_cnt > 1 && target != this_cpu() && target->curr == target->idle){
+    lapic_send_ipi(target->apic_id, RESCHED_VECTOR);
+  }
+}
+
+/* 要求cpu在下一次中断返回前重新调度，不是本CPU时发IPI，让它马上进入中断并在返回时调度 */
+void smp_preempt(uint8_t cpu){
+  cpus[cpu].need_resched = true;
+  if(cpu != cpu_id()){
+    lapic_send_ipi(cpus[cpu].apic_id, RESCHED_VECTOR);
+  }
+}
+
+/* 让其他所有CPU刷新TLB并等待它们完成，
+ * 等待期间若也有别的CPU要求本CPU刷新，一并处理，避免两个CPU互相等待 */
+void smp_flush_tlb_others(void){
+  if(cpu_cnt <= 1){
+    return;
+  }
+  enum intr_status old_status = intr_disable();
+  struct cpu* self = this_cpu();
+  uint8_t id;
+  for(id = 0; id < MAX_CPUS; id++){
+    if(cpus[id].online && &cpus[id] != self){
+      cpus[id].tlb_flush_pending = 1;
+      lapic_send_ipi(cpus[id].apic_id, TLB_FLUSH_VECTOR);
+    }
+  }
+  for(id = 0; id < MAX_CPUS; id++){
+    while(cpus[id].online && &cpus[id] != self && cpus[id].tlb_flush_pending){
+      if(self->tlb_flush_pending){
+        local_flush_tlb();
+        self->tlb_flush_pending = 0;
+      }
+      cpu_relax();
+    }
+  }
+  intr_set_status(old_status);
+}
+
+/* 领取了编号的AP是否都已上线 */
+static bool aps_online(struct ap_mailbox* mailbox){
+  uint32_t claimed = mailbox->next_id < mailbox->cpu_limit ? mailbox->next_id : mailbox->cpu_limit;
+  uint32_t id;
+  for(id = 1; id < claimed; id++){
+    if(!cpus[id].online){
+      return false;
+    }
+  }
+  return true;
+}
+
+/* 启动所有AP，须在创建用户进程之前调用 */
+void smp_init(void){
+  put_str("smp_init start\n");
+  if(!lapic_present()){
+    put_str("smp_init: no local apic, running on one cpu\n");
+    return;
+  }
+  lapic_init();
+  cpus[0].apic_id = lapic_id();
+  register_handler(RESCHED_VECTOR, intr_resched_handler);
+  register_handler(TLB_FLUSH_VECTOR, intr_tlb_flush_handler);
+
+  /* AP数量事先未知，先为每个可能的AP准备好idle线程，其页即为AP的启动栈 */
+  struct ap_mailbox* mailbox = (struct ap_mailbox*)(0xc0000000 + AP_TRAMPOLINE_PADDR + \
+      (ap_mailbox - ap_trampoline_start));
+  memcpy((void*)(0xc0000000 + AP_TRAMPOLINE_PADDR), ap_trampoline_start, ap_trampoline_end - ap_trampoline_start);
+  mailbox->entry = (uint32_t)ap_main;
+  mailbox->cpu_limit = MAX_CPUS;
+  mailbox->next_id = 1;
+  uint8_t id;
+  for(id = 1; id < MAX_CPUS; id++){
+    struct task_struct* idle = idle_thread_create(id);
+    if(idle == NULL){
+      mailbox->cpu_limit = id;
+      break;
+    }
+    mailbox->stacks[id] = (uint32_t)idle + PG_SIZE;
+  }
+
+  enum intr_status old_status = intr_enable();
+  lapic_startup_aps(AP_TRAMPOLINE_PADDR);
+  /* 先留出时间让AP领取编号，之后领到编号的AP全部上线即可结束等待 */
+  volatile uint32_t* now = &ticks;
+  uint32_t start = *now;
+  while(*now - start < AP_BOOT_WAIT_TICKS){
+    if(*now - start >= AP_ARRIVE_TICKS && aps_online(mailbox)){
+      break;
+    }
+    cpu_relax();
+  }
+  intr_set_status(old_status);
+
+  /* 释放没有AP领取的idle线程，领取了编号却超时未上线的AP仍可能在使用其栈，不能释放 */
+  uint32_t claimed = mailbox->next_id < mailbox->cpu_limit ? mailbox->next_id : mailbox->cpu_limit;
+  for(id = 1; id < MAX_CPUS; id++){
+    if(cpus[id].online){
+      cpu_cnt++;
+    }else if(id >= claimed && cpus[id].idle != NULL){
+      free_kernel_pages(cpus[id].idle, 1);
+      cpus[id].idle = NULL;
+    }
+  }
+  put_str("smp_init done, cpus online: ");
+  put_int(cpu_cnt);
+  put_char('\n');
+}
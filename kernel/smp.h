@@ -0,0 +1,35 @@
+#ifndef __KERNEL_SMP_H
+#define __KERNEL_SMP_H
+#include "stdint.h"
+#include "global.h"
+
+#define MAX_CPUS 8      //最多支持的CPU数，须与trampoline.S中ap_stacks的大小一致
+
+struct task_struct;
+
+/* 每个CPU的私有信息，以cpu编号为下标存放在cpus数组中，BSP的编号为0 */
+struct cpu{
+  uint8_t id;                           //逻辑编号
+  uint8_t apic_id;                      //本地APIC的ID，发送IPI时使用
+  volatile bool online;                 //是否已启动完毕，可以参与调度
+  struct task_struct* idle;             //本CPU的idle线程
+  struct task_struct* volatile curr;    //本CPU当前运行的线程
+  volatile uint32_t tlb_flush_pending;  //其他CPU要求本CPU刷新TLB
+  struct task_struct* fpu_owner;        //FPU寄存器中保存的是哪个线程的状态
+  volatile bool need_resched;           //有更应该运行的线程被唤醒，中断返回前重新调度
+};
+
+extern struct cpu cpus[MAX_CPUS];
+extern uint8_t cpu_cnt;     //已上线的CPU数
+
+/* 当前CPU的编号，线程可能在开中断时被迁移，调用者需关中断才能保证结果仍然有效 */
+#define cpu_id() (running_thread()->cpu)
+#define this_cpu() (&cpus[cpu_id()])
+
+void smp_early_init(void);
+void smp_init(void);
+void ap_main(uint32_t id);
+void smp_resched(uint8_t cpu);
+void smp_preempt(uint8_t cpu);
+void smp_flush_tlb_others(void);
+#endif
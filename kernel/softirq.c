@@ -0,0 +1,114 @@
+#include "softirq.h"
+#include "stdint.h"
+#include "global.h"
+#include "interrupt.h"
+#include "spinlock.h"
+#include "thread.h"
+#include "smp.h"
+#include "debug.h"
+
+/* 每个CPU的软中断状态，只由本CPU在关中断时访问 */
+struct softirq_cpu{
+  uint32_t pending;             //第n位为1表示第n号软中断待处理
+  bool active;                  //是否正在处理软中断，此时返回的是嵌套的中断
+  struct tasklet* head;         //待运行的tasklet
+  struct tasklet** tail;
+};
+
+static struct softirq_cpu softirq_cpus[MAX_CPUS];
+static softirq_action* softirq_vec[SOFTIRQ_NR];
+
+/* 运行本CPU上所有待运行的tasklet，先整体摘下，运行时可以再次调度 */
+static void tasklet_action(void){
+  enum intr_status old_status = intr_disable();
+  struct softirq_cpu* sc = &softirq_cpus[cpu_id()];
+  struct tasklet* t = sc->head;
+  sc->head = NULL;
+  sc->tail = &sc->head;
+  intr_set_status(old_status);
+  while(t != NULL){
+    struct tasklet* next = t->next;
+    t->scheduled = 0;
+    t->func(t->arg);
+    t = next;
+  }
+}
+
+/* 初始化各CPU的软中断状态 */
+void softirq_init(void){
+  uint32_t cpu, nr;
+  for(cpu = 0; cpu < MAX_CPUS; cpu++){
+    softirq_cpus[cpu].pending = 0;
+    softirq_cpus[cpu].active = false;
+    softirq_cpus[cpu].head = NULL;
+    softirq_cpus[cpu].tail = &softirq_cpus[cpu].head;
+  }
+  for(nr = 0; nr < SOFTIRQ_NR; nr++){
+    softirq_vec[nr] = NULL;
+  }
+  open_softirq(SOFTIRQ_TASKLET, tasklet_action);
+}
+
+/* 注册第nr号软中断的处理函数 */
+void open_softirq(enum softirq_nr nr, softirq_action* action){
+  softirq_vec[nr] = action;
+}
+
+/* 在本CPU上标记第nr号软中断待处理 */
+void raise_softirq(enum softirq_nr nr){
+  enum intr_status old_status = intr_disable();
+  softirq_cpus[cpu_id()].pending |= (1 << nr);
+  intr_set_status(old_status);
+}
+
+/* 本CPU是否正在处理软中断，须关中断 */
+bool softirq_active(void){
+  return softirq_cpus[cpu_id()].active;
+}
+
+/* 处理本CPU上待处理的软中断，须关中断，处理函数在开中断时执行。
+ * 由intr_exit在被中断的代码开着中断时调用，已在处理中时直接返回 */
+void do_softirq(void){
+  ASSERT(intr_get_status() == INTR_OFF);
+  struct softirq_cpu* sc = &softirq_cpus[cpu_id()];
+  if(sc->active){
+    return;
+  }
+  sc->active = true;
+  uint32_t restart = SOFTIRQ_MAX_RESTART;
+  uint32_t pending;
+  while((pending = sc->pending) != 0 && restart-- > 0){
+    sc->pending = 0;
+    intr_enable();
+    while(pending != 0){
+      uint32_t nr;
+      asm ("bsfl %1, %0" : "=r"(nr) : "rm"(pending));
+      pending &= ~(1 << nr);
+      softirq_vec[nr]();
+    }
+    intr_disable();
+  }
+  sc->active = false;
+}
+
+/* 初始化tasklet，被调度后在软中断中调用func(arg) */
+void tasklet_init(struct tasklet* t, tasklet_func* func, void* arg){
+  t->next = NULL;
+  t->func = func;
+  t->arg = arg;
+  t->scheduled = 0;
+}
+
+/* 把t挂到本CPU的待运行链表中，已经在某个链表中时什么也不做 */
+void tasklet_schedule(struct tasklet* t){
+  if(atomic_xchg(&t->scheduled, 1) != 0){
+    return;
+  }
+  enum intr_status old_status = intr_disable();
+  struct softirq_cpu* sc = &softirq_cpus[cpu_id()];
+  t->next = NULL;
+  *sc->tail = t;
+  sc->tail = &t->next;
+  sc->pending |= (1 << SOFTIRQ_TASKLET);
+  intr_set_status(old_status);
+}
@@ -0,0 +1,40 @@
+#ifndef __KERNEL_SOFTIRQ_H
+#define __KERNEL_SOFTIRQ_H
+#include "stdint.h"
+#include "global.h"
+
+/********** 软中断 **********
+ * 中断处理程序只做必须在关中断时完成的部分（读端口、应答设备），
+ * 其余工作标记为待处理的软中断，在intr_exit返回被中断的代码之前开中断执行，
+ * 缩短关中断的时间。软中断在哪个CPU上标记就在哪个CPU上执行，
+ * 执行期间不会调度，处理函数不能阻塞。
+ * 小的工作项用tasklet挂到TASKLET软中断上，需要阻塞的工作用workqueue交给内核线程
+ * *************************/
+enum softirq_nr{
+  SOFTIRQ_TIMER,        //到期定时器
+  SOFTIRQ_TASKLET,      //各驱动的tasklet
+  SOFTIRQ_RCU,          //RCU宽限期结束后的处理
+  SOFTIRQ_NR
+};
+
+#define SOFTIRQ_MAX_RESTART 8   //处理期间又被标记的软中断最多重新处理的轮数，余下的留到下一次中断返回时
+
+typedef void softirq_action(void);
+typedef void tasklet_func(void* arg);
+
+/* tasklet，同一时刻只会在一个CPU的待处理链表中，运行前清除scheduled，运行期间可以再次被调度 */
+struct tasklet{
+  struct tasklet* next;
+  tasklet_func* func;
+  void* arg;
+  volatile uint32_t scheduled;
+};
+
+void softirq_init(void);
+void open_softirq(enum softirq_nr nr, softirq_action* action);
+void raise_softirq(enum softirq_nr nr);
+bool softirq_active(void);
+void do_softirq(void);
+void tasklet_init(struct tasklet* t, tasklet_func* func, void* arg);
+void tasklet_schedule(struct tasklet* t);
+#endif
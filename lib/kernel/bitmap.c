@@ -75,3 +75,40 @@ void bitmap_set(struct bitmap* btmp, uint32_t bit_idx, int8_t value){
   }
 }
 
+
+
+/* 统计位图中最长的连续空闲位数并返回，free_bits不为NULL时顺便返回空闲位总数 */
+uint32_t bitmap_max_free_run(struct bitmap* btmp, uint32_t* free_bits){
+  uint32_t byte_idx, bit_odd, run = 0, max_run = 0, free_cnt = 0;
+  for(byte_idx = 0; byte_idx < btmp->btmp_bytes_len; byte_idx++){
+    uint8_t byte = btmp->bits[byte_idx];
+    /* 整字节全空闲或全占用时不必逐位比对 */
+    if(byte == 0){
+      run += 8;
+      free_cnt += 8;
+      if(run > max_run){
+        max_run = run;
+      }
+      continue;
+    }
+    if(byte == 0xff){
+      run = 0;
+      continue;
+    }
+    for(bit_odd = 0; bit_odd < 8; bit_odd++){
+      if(byte & (BITMAP_MASK << bit_odd)){
+        run = 0;
+      }else{
+        run++;
+        free_cnt++;
+        if(run > max_run){
+          max_run = run;
+        }
+      }
+    }
+  }
+  if(free_bits != NULL){
+    *free_bits = free_cnt;
+  }
+  return max_run;
+}
\ No newline at end of file
@@ -14,5 +14,6 @@ void bitmap_init(struct bitmap* btmp);
 bool bitmap_scan_test(struct bitmap* btmp, uint32_t bit_idx);
 int bitmap_scan(struct bitmap* btmp, uint32_t cnt);
 void bitmap_set(struct bitmap* btmp, uint32_t bit_idx, int8_t value);
+uint32_t bitmap_max_free_run(struct bitmap* btmp, uint32_t* free_bits);
 
 #endif
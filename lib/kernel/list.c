@@ -10,6 +10,7 @@ void list_init(struct list* list){
   list->tail.next = NULL;
   list->head.next = &list->tail;
   list->tail.prev = &list->head;
+  list->head.owner = list->tail.owner = list;
 }
 
 /* 把链表元素elem插入在元素before之前 */
@@ -22,6 +23,7 @@ void list_insert_before(struct list_elem* before, struct list_elem* elem){
   elem->prev = before->prev;
   elem->next = before;
   before->prev = elem;
+  elem->owner = before->owner;
 
   intr_set_status(old_status);      //恢复以前的中断状态
 }
@@ -38,10 +40,15 @@ void list_append(struct list* plist, struct list_elem* elem){
 
 /* 使元素pelem脱离链表 */
 void list_remove(struct list_elem* pelem){
+  ASSERT(pelem->owner != NULL);
+  /* O(1)地核对前后节点确实指回pelem，遍历核对owner的代价为O(n)，只在DEBUG_SLOW构建中进行 */
+  ASSERT(pelem->prev->next == pelem && pelem->next->prev == pelem);
+  ASSERT_SLOW(elem_find(pelem->owner, pelem));
   enum intr_status old_status = intr_disable();
 
   pelem->prev->next = pelem->next;
   pelem->next->prev = pelem->prev;
+  pelem->owner = NULL;
   
   intr_set_status(old_status);
 }
@@ -18,11 +18,15 @@
  */
 #define elem2entry(struct_type, struct_member_name, elem_ptr) (struct_type*)((int)elem_ptr - offset(struct_type, struct_member_name))
 
+struct list;
+
 /********** 定义链表结点成员结构 **********
- * 节点中不需要数据元，只需要前后指针即可*/
+ * 节点中不需要数据元，只需要前后指针即可，
+ * owner记录节点所在的链表，判断节点是否在某链表中时不必遍历*/
 struct list_elem{
   struct list_elem* prev;   //前驱节点
   struct list_elem* next;   //后继节点
+  struct list* owner;       //所在的链表，不在任何链表中时为NULL
 };
 
 /* 链表结构，用来实现队列 */
@@ -47,4 +51,9 @@ bool list_empty(struct list* plist);
 uint32_t list_len(struct list* plist);
 struct list_elem* list_traversal(struct list* plist, function func, int arg);
 bool elem_find(struct list* plist, struct list_elem* obj_elem);
+
+/* 判断elem是否在链表plist中，O(1)，elem须已清零或曾由链表操作维护过 */
+static inline bool elem_on_list(struct list* plist, struct list_elem* elem){
+  return elem->owner == plist;
+}
 #endif
\ No newline at end of file
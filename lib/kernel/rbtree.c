@@ -0,0 +1,227 @@
+#include "rbtree.h"
+#include "global.h"
+#include "stdint.h"
+
+/* 初始化为空树 */
+void rb_init(struct rb_root* root){
+  root->node = NULL;
+}
+
+/* 判断树是否为空 */
+bool rb_empty(struct rb_root* root){
+  return root->node == NULL;
+}
+
+/* 用new替换old在其父节点（或根）中的位置 */
+static void rb_replace_child(struct rb_node* old, struct rb_node* new, struct rb_node* parent, struct rb_root* root){
+  if(parent == NULL){
+    root->node = new;
+  }else if(parent->left == old){
+    parent->left = new;
+  }else{
+    parent->right = new;
+  }
+}
+
+/* 以node为轴左旋，node的右孩子升上来 */
+static void rb_rotate_left(struct rb_node* node, struct rb_root* root){
+  struct rb_node* right = node->right;
+  struct rb_node* parent = node->parent;
+  node->right = right->left;
+  if(right->left != NULL){
+    right->left->parent = node;
+  }
+  right->left = node;
+  right->parent = parent;
+  rb_replace_child(node, right, parent, root);
+  node->parent = right;
+}
+
+/* 以node为轴右旋，node的左孩子升上来 */
+static void rb_rotate_right(struct rb_node* node, struct rb_root* root){
+  struct rb_node* left = node->left;
+  struct rb_node* parent = node->parent;
+  node->left = left->right;
+  if(left->right != NULL){
+    left->right->parent = node;
+  }
+  left->right = node;
+  left->parent = parent;
+  rb_replace_child(node, left, parent, root);
+  node->parent = left;
+}
+
+static bool is_red(struct rb_node* node){
+  return node != NULL && node->color == RB_RED;
+}
+
+/* 新挂上的红节点node可能与红色的父节点相连，自下而上修正 */
+void rb_insert_color(struct rb_node* node, struct rb_root* root){
+  struct rb_node* parent;
+  while(is_red(parent = node->parent)){
+    struct rb_node* gparent = parent->parent;   //父节点为红，必不是根，祖父节点存在
+    if(parent == gparent->left){
+      struct rb_node* uncle = gparent->right;
+      if(is_red(uncle)){        //叔节点为红，父叔变黑，祖父变红后继续向上
+        parent->color = uncle->color = RB_BLACK;
+        gparent->color = RB_RED;
+        node = gparent;
+        continue;
+      }
+      if(node == parent->right){    //先转成外侧的情形
+        rb_rotate_left(parent, root);
+        node = parent;
+        parent = node->parent;
+      }
+      parent->color = RB_BLACK;
+      gparent->color = RB_RED;
+      rb_rotate_right(gparent, root);
+    }else{
+      struct rb_node* uncle = gparent->left;
+      if(is_red(uncle)){
+        parent->color = uncle->color = RB_BLACK;
+        gparent->color = RB_RED;
+        node = gparent;
+        continue;
+      }
+      if(node == parent->left){
+        rb_rotate_right(parent, root);
+        node = parent;
+        parent = node->parent;
+      }
+      parent->color = RB_BLACK;
+      gparent->color = RB_RED;
+      rb_rotate_left(gparent, root);
+    }
+  }
+  root->node->color = RB_BLACK;
+}
+
+/* 删除黑节点后，node（可能为NULL）所在的一侧少了一个黑节点，自下而上修正 */
+static void rb_erase_color(struct rb_node* node, struct rb_node* parent, struct rb_root* root){
+  while(node != root->node && !is_red(node)){
+    if(node == parent->left){
+      struct rb_node* sibling = parent->right;
+      if(is_red(sibling)){      //兄弟为红，转成兄弟为黑的情形
+        sibling->color = RB_BLACK;
+        parent->color = RB_RED;
+        rb_rotate_left(parent, root);
+        sibling = parent->right;
+      }
+      if(!is_red(sibling->left) && !is_red(sibling->right)){
+        sibling->color = RB_RED;    //兄弟一侧也去掉一个黑节点，问题移到父节点
+        node = parent;
+        parent = node->parent;
+        continue;
+      }
+      if(!is_red(sibling->right)){  //先转成兄弟的外侧孩子为红的情形
+        sibling->left->color = RB_BLACK;
+        sibling->color = RB_RED;
+        rb_rotate_right(sibling, root);
+        sibling = parent->right;
+      }
+      sibling->color = parent->color;
+      parent->color = RB_BLACK;
+      sibling->right->color = RB_BLACK;
+      rb_rotate_left(parent, root);
+      node = root->node;
+    }else{
+      struct rb_node* sibling = parent->left;
+      if(is_red(sibling)){
+        sibling->color = RB_BLACK;
+        parent->color = RB_RED;
+        rb_rotate_right(parent, root);
+        sibling = parent->left;
+      }
+      if(!is_red(sibling->left) && !is_red(sibling->right)){
+        sibling->color = RB_RED;
+        node = parent;
+        parent = node->parent;
+        continue;
+      }
+      if(!is_red(sibling->left)){
+        sibling->right->color = RB_BLACK;
+        sibling->color = RB_RED;
+        rb_rotate_left(sibling, root);
+        sibling = parent->left;
+      }
+      sibling->color = parent->color;
+      parent->color = RB_BLACK;
+      sibling->left->color = RB_BLACK;
+      rb_rotate_right(parent, root);
+      node = root->node;
+    }
+  }
+  if(node != NULL){
+    node->color = RB_BLACK;
+  }
+}
+
+/* 从树中删除node */
+void rb_erase(struct rb_node* node, struct rb_root* root){
+  struct rb_node* child, *parent;
+  uint8_t color;
+  if(node->left != NULL && node->right != NULL){
+    /* 有两个孩子时，用后继节点succ顶替node的位置和颜色，实际删除的是succ原来的位置 */
+    struct rb_node* succ = node->right;
+    while(succ->left != NULL){
+      succ = succ->left;
+    }
+    child = succ->right;
+    color = succ->color;
+    if(succ->parent == node){
+      parent = succ;
+    }else{
+      parent = succ->parent;
+      parent->left = child;
+      if(child != NULL){
+        child->parent = parent;
+      }
+      succ->right = node->right;
+      node->right->parent = succ;
+    }
+    succ->left = node->left;
+    node->left->parent = succ;
+    succ->parent = node->parent;
+    succ->color = node->color;
+    rb_replace_child(node, succ, node->parent, root);
+  }else{
+    child = node->left != NULL ? node->left : node->right;
+    parent = node->parent;
+    color = node->color;
+    if(child != NULL){
+      child->parent = parent;
+    }
+    rb_replace_child(node, child, parent, root);
+  }
+  if(color == RB_BLACK){
+    rb_erase_color(child, parent, root);
+  }
+}
+
+/* 返回最左（最小）的节点，空树返回NULL */
+struct rb_node* rb_first(struct rb_root* root){
+  struct rb_node* node = root->node;
+  if(node == NULL){
+    return NULL;
+  }
+  while(node->left != NULL){
+    node = node->left;
+  }
+  return node;
+}
+
+/* 返回中序遍历中node的下一个节点，node是最大节点时返回NULL */
+struct rb_node* rb_next(struct rb_node* node){
+  if(node->right != NULL){
+    node = node->right;
+    while(node->left != NULL){
+      node = node->left;
+    }
+    return node;
+  }
+  while(node->parent != NULL && node == node->parent->right){
+    node = node->parent;
+  }
+  return node->parent;
+}
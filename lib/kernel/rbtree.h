@@ -0,0 +1,39 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+#include "global.h"
+#include "stdint.h"
+
+/********** 红黑树 **********
+ * 节点嵌入在宿主结构中，与list_elem一样用elem2entry取得宿主。
+ * 树本身不比较键值，插入时由调用者自上而下找到位置，
+ * 用rb_link_node挂上新节点后再调用rb_insert_color恢复平衡
+ * **************************/
+#define RB_RED 0
+#define RB_BLACK 1
+
+struct rb_node{
+  struct rb_node* parent;
+  struct rb_node* left;
+  struct rb_node* right;
+  uint8_t color;
+};
+
+struct rb_root{
+  struct rb_node* node;     //根节点，NULL表示空树
+};
+
+/* 把node挂到parent下由link指向的空位上，link是&parent->left或&parent->right，空树时是&root->node */
+static inline void rb_link_node(struct rb_node* node, struct rb_node* parent, struct rb_node** link){
+  node->parent = parent;
+  node->left = node->right = NULL;
+  node->color = RB_RED;
+  *link = node;
+}
+
+void rb_init(struct rb_root* root);
+void rb_insert_color(struct rb_node* node, struct rb_root* root);
+void rb_erase(struct rb_node* node, struct rb_root* root);
+struct rb_node* rb_first(struct rb_root* root);
+struct rb_node* rb_next(struct rb_node* node);
+bool rb_empty(struct rb_root* root);
+#endif
@@ -1,7 +1,8 @@
 #include "syscall.h"
+#include "vdso.h"
 
 /* 无参数的系统调用 */
-#define _syscall0(NUMBER) ({    \
+#define _int80_syscall0(NUMBER) ({    \
     int retval;                 \
     asm volatile(               \
         "int $0x80"              \
@@ -13,7 +14,7 @@
     })
 
 /* 一个参数的系统调用 */
-#define _syscall1(NUMBER, ARG1) ({    \
+#define _int80_syscall1(NUMBER, ARG1) ({    \
     int retval;                 \
     asm volatile(               \
         "int $0x80"              \
@@ -25,7 +26,7 @@
     })
 
 /* 两个参数的系统调用 */
-#define _syscall2(NUMBER, ARG1, ARG2) ({    \
+#define _int80_syscall2(NUMBER, ARG1, ARG2) ({    \
     int retval;                 \
     asm volatile(               \
         "int $0x80"              \
@@ -37,7 +38,7 @@
     })
 
 /* 三个参数的系统调用 */
-#define _syscall3(NUMBER, ARG1, ARG2, ARG3) ({    \
+#define _int80_syscall3(NUMBER, ARG1, ARG2, ARG3) ({    \
     int retval;                 \
     asm volatile(               \
         "int $0x80"              \
@@ -48,9 +49,45 @@
     retval;                     \
     })
 
-/* 返回当前任务的pid */
+/* 用sysenter进入内核，ecx和edx要用来带上用户栈和返回地址，参数改由ebx、esi、edi传递，
+ * 返回后ecx和edx的值不保留 */
+#define _sysenter_syscall(NUMBER, ARG1, ARG2, ARG3) ({    \
+    int retval;                 \
+    asm volatile(               \
+        "movl %%esp, %%ecx\n\t" \
+        "movl $1f, %%edx\n\t"   \
+        "sysenter\n"            \
+        "1:"                    \
+        : "=a"(retval)          \
+        : "a"(NUMBER), "b"(ARG1), "S"(ARG2), "D"(ARG3)   \
+        : "ecx", "edx", "memory"  \
+        );                      \
+    retval;                     \
+    })
+
+/* 第一次系统调用时检测CPU是否支持sysenter，不支持时仍用int 0x80，
+ * 须是初始化过的全局变量，bss不会被清零 */
+static int8_t use_sysenter = -1;
+
+static bool sysenter_usable(void){
+  if(use_sysenter < 0){
+    use_sysenter = sysenter_supported();
+  }
+  return use_sysenter;
+}
+
+#define _syscall0(NUMBER) (sysenter_usable() ? \
+    _sysenter_syscall(NUMBER, 0, 0, 0) : _int80_syscall0(NUMBER))
+#define _syscall1(NUMBER, ARG1) (sysenter_usable() ? \
+    _sysenter_syscall(NUMBER, ARG1, 0, 0) : _int80_syscall1(NUMBER, ARG1))
+#define _syscall2(NUMBER, ARG1, ARG2) (sysenter_usable() ? \
+    _sysenter_syscall(NUMBER, ARG1, ARG2, 0) : _int80_syscall2(NUMBER, ARG1, ARG2))
+#define _syscall3(NUMBER, ARG1, ARG2, ARG3) (sysenter_usable() ? \
+    _sysenter_syscall(NUMBER, ARG1, ARG2, ARG3) : _int80_syscall3(NUMBER, ARG1, ARG2, ARG3))
+
+/* 返回当前进程的pid，从内核映射的只读页中读取，不进入内核 */
 uint32_t getpid(){
-  return _syscall0(SYS_GETPID);
+  return vdso_getpid();
 }
 
 /* 系统调用write */
@@ -66,4 +103,69 @@ void* malloc(uint32_t size){
 /* 系统调用free */
 void free(void* ptr){
   _syscall1(SYS_FREE, ptr);
-}
\ No newline at end of file
+}
+
+/* 获取内存统计快照 */
+int32_t memstat(struct mem_stats* stats){
+  return _syscall1(SYS_MEMSTAT, stats);
+}
+
+/* 获取全部线程的调度统计快照，返回得到的项数 */
+int32_t schedstat(struct task_stat* buf, uint32_t cnt){
+  return _syscall2(SYS_SCHEDSTAT, buf, cnt);
+}
+
+/* *uaddr等于val时睡眠，直到被futex_wake唤醒，值不等时立即返回-1 */
+int32_t futex_wait(uint32_t* uaddr, uint32_t val){
+  return _syscall2(SYS_FUTEX_WAIT, uaddr, val);
+}
+
+/* 最多唤醒cnt个在uaddr上等待的线程，返回唤醒的个数 */
+int32_t futex_wake(uint32_t* uaddr, uint32_t cnt){
+  return _syscall2(SYS_FUTEX_WAKE, uaddr, cnt);
+}
+
+/* 在当前进程中创建执行function(arg)的线程，tls为其线程局部存储，返回新线程的pid */
+int32_t uthread_create(void (*function)(void*), void* arg, void* tls){
+  return _syscall3(SYS_UTHREAD_CREATE, function, arg, tls);
+}
+
+/* 结束当前线程，进程的最后一个线程结束时释放进程的地址空间，不再返回 */
+void uthread_exit(int32_t status){
+  _syscall1(SYS_UTHREAD_EXIT, status);
+}
+
+/* 用户线程的返回地址，线程函数返回时从这里结束线程 */
+void uthread_return(void){
+  uthread_exit(0);
+}
+
+/* 设置当前线程局部存储的基址，之后通过gs访问 */
+int32_t set_tls(void* base){
+  return _syscall1(SYS_SET_TLS, base);
+}
+
+/* 创建本进程的提交/完成环，返回共享页的地址，失败返回NULL */
+struct uring* uring_setup(uint32_t flags){
+  return (struct uring*)_syscall1(SYS_URING_SETUP, flags);
+}
+
+/* 处理至多to_submit个已提交的项，返回处理的个数，见uring.h */
+int32_t uring_enter(uint32_t to_submit, uint32_t min_complete, uint32_t flags){
+  return _syscall3(SYS_URING_ENTER, to_submit, min_complete, flags);
+}
+
+/* 开关内存分配追踪或输出报告，cmd为enum memtrace_cmd */
+int32_t memtrace(uint32_t cmd, uint32_t arg){
+  return _syscall2(SYS_MEMTRACE, cmd, arg);
+}
+
+/* 开关关中断时长追踪或输出报告，cmd为enum irqtrace_cmd */
+int32_t irqtrace(uint32_t cmd){
+  return _syscall1(SYS_IRQTRACE, cmd);
+}
+
+/* 更改当前线程的调度类，0为SCHED_FAIR，1为SCHED_MLFQ */
+int32_t setpolicy(uint32_t policy){
+  return _syscall1(SYS_SETPOLICY, policy);
+}
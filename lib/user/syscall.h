@@ -1,14 +1,55 @@
 #ifndef __LIB_USER_SYSCALL_H
 #define __LIB_USER_SYSCALL_H
 #include "stdint.h"
+#include "global.h"
 enum SYSCALL_NR{
   SYS_GETPID,
   SYS_WRITE,
   SYS_MALLOC,
-  SYS_FREE
+  SYS_FREE,
+  SYS_MEMSTAT,
+  SYS_SCHEDSTAT,
+  SYS_FUTEX_WAIT,
+  SYS_FUTEX_WAKE,
+  SYS_UTHREAD_CREATE,
+  SYS_SET_TLS,
+  SYS_URING_SETUP,
+  SYS_URING_ENTER,
+  SYS_MEMTRACE,
+  SYS_IRQTRACE,
+  SYS_SETPOLICY,
+  SYS_UTHREAD_EXIT
 };
+
+#define CPUID_SEP (1 << 11)
+
+/* CPU是否支持sysenter/sysexit，内核据此设置MSR，用户态据此选择进入内核的方式。
+ * cpuid不是特权指令，用户态也可以执行；早期的Pentium Pro报告SEP却并不支持 */
+static inline bool sysenter_supported(void){
+  uint32_t eax = 1, ebx, ecx = 0, edx;
+  asm volatile ("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+  uint32_t family = (eax >> 8) & 0xf, model = (eax >> 4) & 0xf, stepping = eax & 0xf;
+  return (edx & CPUID_SEP) && !(family == 6 && model < 3 && stepping < 3);
+}
+
+struct mem_stats;
+struct task_stat;
+struct uring;
 uint32_t getpid(void);
 uint32_t write(char* str);
 void* malloc(uint32_t size);
 void free(void* ptr);
+int32_t memstat(struct mem_stats* stats);
+int32_t schedstat(struct task_stat* buf, uint32_t cnt);
+int32_t futex_wait(uint32_t* uaddr, uint32_t val);
+int32_t futex_wake(uint32_t* uaddr, uint32_t cnt);
+int32_t uthread_create(void (*function)(void*), void* arg, void* tls);
+void uthread_exit(int32_t status);
+void uthread_return(void);
+int32_t set_tls(void* base);
+struct uring* uring_setup(uint32_t flags);
+int32_t uring_enter(uint32_t to_submit, uint32_t min_complete, uint32_t flags);
+int32_t memtrace(uint32_t cmd, uint32_t arg);
+int32_t irqtrace(uint32_t cmd);
+int32_t setpolicy(uint32_t policy);
 #endif
\ No newline at end of file
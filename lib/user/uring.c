@@ -0,0 +1,55 @@
+#include "uring.h"
+#include "stdint.h"
+#include "global.h"
+#include "syscall.h"
+
+/* 取一个空闲的提交项，由调用者填写，SQ已满时返回NULL。
+ * 取到的项在uring_submit之前对内核不可见，同一个环只应由一个线程提交 */
+struct uring_sqe* uring_get_sqe(struct uring* ring){
+  if(ring->sq_local - ring->sq_head >= URING_SQ_ENTRIES){
+    return NULL;
+  }
+  struct uring_sqe* sqe = &ring->sqes[ring->sq_local & URING_SQ_MASK];
+  ring->sq_local++;
+  return sqe;
+}
+
+/* 提交所有已填写的项，返回本次提交的个数。
+ * 普通模式下进入内核一次处理完；SQPOLL模式下只在poller睡眠时才进入内核唤醒它 */
+int32_t uring_submit(struct uring* ring){
+  uint32_t cnt = ring->sq_local - ring->sq_tail;
+  uring_barrier();              //提交项的内容要先于sq_tail写入
+  ring->sq_tail = ring->sq_local;
+  if(ring->setup_flags & URING_SETUP_SQPOLL){
+    uring_mb();                 //先让poller看到sq_tail，再读它是否睡眠
+    if(ring->flags & URING_NEED_WAKEUP){
+      uring_enter(0, 0, URING_ENTER_WAKEUP);
+    }
+    return cnt;
+  }
+  return cnt == 0 ? 0 : uring_enter(cnt, 0, 0);
+}
+
+/* 取走一个完成项存入cqe，CQ为空时返回-1 */
+int32_t uring_peek_cqe(struct uring* ring, struct uring_cqe* cqe){
+  uint32_t head = ring->cq_head;
+  if(head == ring->cq_tail){
+    return -1;
+  }
+  uring_barrier();              //看到cq_tail之后再读完成项
+  *cqe = ring->cqes[head & URING_CQ_MASK];
+  uring_barrier();              //读完之后内核才能复用这一项
+  ring->cq_head = head + 1;
+  return 0;
+}
+
+/* 取走一个完成项存入cqe，CQ为空时等待，普通模式下没有未完成的请求，CQ为空时返回-1 */
+int32_t uring_wait_cqe(struct uring* ring, struct uring_cqe* cqe){
+  while(uring_peek_cqe(ring, cqe) != 0){
+    if(!(ring->setup_flags & URING_SETUP_SQPOLL)){
+      return -1;
+    }
+    uring_enter(0, 1, URING_ENTER_GETEVENTS);
+  }
+  return 0;
+}
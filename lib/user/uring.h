@@ -0,0 +1,73 @@
+#ifndef __LIB_USER_URING_H
+#define __LIB_USER_URING_H
+#include "stdint.h"
+
+/********** 提交/完成环 **********
+ * 进程与内核共享一页内存，其中有提交环(SQ)和完成环(CQ)：
+ * 用户填好若干提交项后移动sq_tail，内核取走后移动sq_head，
+ * 每完成一项就在CQ中放一个完成项并移动cq_tail，用户取走后移动cq_head。
+ * 头尾指针只增不减，取下标时与掩码相与，两环各自只有一个生产者和一个消费者。
+ * 内核在uring_enter中一次处理全部已提交的项，批量操作只需进入内核一次；
+ * 以URING_SETUP_SQPOLL创建时内核另有一个poller线程轮询SQ，
+ * 用户提交时通常不必进入内核，poller闲置过久而睡眠时才要用uring_enter唤醒它
+ * *******************************/
+#define URING_SQ_ENTRIES 64     //2的幂
+#define URING_CQ_ENTRIES 128    //是SQ的两倍，取完成项稍慢时也不会挡住提交
+#define URING_SQ_MASK (URING_SQ_ENTRIES - 1)
+#define URING_CQ_MASK (URING_CQ_ENTRIES - 1)
+
+/* uring_setup的flags */
+#define URING_SETUP_SQPOLL 1    //创建poller线程轮询SQ
+
+/* uring_enter的flags */
+#define URING_ENTER_GETEVENTS 1 //等到CQ中至少有min_complete个完成项，仅SQPOLL模式有效
+#define URING_ENTER_WAKEUP 2    //唤醒睡眠的poller
+
+/* uring->flags，由内核设置 */
+#define URING_NEED_WAKEUP 1     //poller已睡眠，提交后要用URING_ENTER_WAKEUP唤醒
+
+/* 操作码，小于SYS_URING_SETUP的就是系统调用号，参数与对应的系统调用相同，结果为其返回值。
+ * 会阻塞的操作（如futex_wait）会推迟同一个环中其后的项 */
+#define URING_OP_DISK_READ 0x80   //args: 分区内扇区号，用户缓冲区，扇区数；读暂存分区，成功返回0
+#define URING_OP_DISK_WRITE 0x81  //同上，写暂存分区
+/* 暂存分区是第一个未挂载的分区，挂载的分区只能经文件系统访问，没有暂存分区时两者都返回-1 */
+
+/* 提交项 */
+struct uring_sqe{
+  uint8_t opcode;
+  uint8_t flags;                //保留，置0
+  uint16_t pad;
+  uint32_t user_data;           //原样带回到完成项中，用于对应请求
+  uint32_t args[3];
+};
+
+/* 完成项 */
+struct uring_cqe{
+  uint32_t user_data;
+  int32_t res;                  //操作的返回值，操作码无效时为-1
+};
+
+/* 共享页的布局 */
+struct uring{
+  volatile uint32_t sq_head;    //内核写
+  volatile uint32_t sq_tail;    //用户写
+  volatile uint32_t cq_head;    //用户写
+  volatile uint32_t cq_tail;    //内核写
+  volatile uint32_t flags;      //URING_NEED_WAKEUP
+  uint32_t setup_flags;         //创建时的flags
+  uint32_t sq_local;            //用户已填写但尚未提交的尾部，只在用户态使用
+  uint32_t pad;
+  struct uring_sqe sqes[URING_SQ_ENTRIES];
+  struct uring_cqe cqes[URING_CQ_ENTRIES];
+};
+
+/* 编译器屏障，x86上写写、读读不会乱序，只需防止编译器重排 */
+#define uring_barrier() asm volatile ("" : : : "memory")
+/* 全屏障，防止先写后读被CPU乱序：用户写sq_tail后读flags，poller写flags后读sq_tail */
+#define uring_mb() asm volatile ("lock; addl $0, (%%esp)" : : : "memory")
+
+struct uring_sqe* uring_get_sqe(struct uring* ring);
+int32_t uring_submit(struct uring* ring);
+int32_t uring_peek_cqe(struct uring* ring, struct uring_cqe* cqe);
+int32_t uring_wait_cqe(struct uring* ring, struct uring_cqe* cqe);
+#endif
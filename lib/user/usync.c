@@ -0,0 +1,86 @@
+#include "usync.h"
+#include "stdint.h"
+#include "syscall.h"
+
+/* 若*ptr等于old就把它置为new，返回*ptr原来的值 */
+static inline uint32_t cmpxchg(volatile uint32_t* ptr, uint32_t old, uint32_t new){
+  uint32_t prev;
+  asm volatile ("lock cmpxchgl %2, %1" : "=a"(prev), "+m"(*ptr) : "r"(new), "0"(old) : "memory");
+  return prev;
+}
+
+/* 原子地把*ptr置为val，返回旧值 */
+static inline uint32_t xchg(volatile uint32_t* ptr, uint32_t val){
+  asm volatile ("xchgl %0, %1" : "+r"(val), "+m"(*ptr) : : "memory");
+  return val;
+}
+
+/* 原子地把*ptr加上val，返回加之前的值 */
+static inline uint32_t xadd(volatile uint32_t* ptr, uint32_t val){
+  asm volatile ("lock xaddl %0, %1" : "+r"(val), "+m"(*ptr) : : "memory");
+  return val;
+}
+
+/* 初始化互斥锁 */
+void umutex_init(struct umutex* m){
+  m->state = 0;
+}
+
+/* 获取互斥锁，空闲时一次cmpxchg拿到，
+ * 否则把state置为2表示有人等待，再睡到state不为2为止，醒来后重新抢 */
+void umutex_lock(struct umutex* m){
+  uint32_t c = cmpxchg(&m->state, 0, 1);
+  if(c == 0){
+    return;
+  }
+  /* 以2的状态拿到锁，释放时才知道要唤醒别人 */
+  if(c != 2){
+    c = xchg(&m->state, 2);
+  }
+  while(c != 0){
+    futex_wait((uint32_t*)&m->state, 2);
+    c = xchg(&m->state, 2);
+  }
+}
+
+/* 尝试获取互斥锁，成功返回0，锁已被持有时返回-1 */
+int32_t umutex_trylock(struct umutex* m){
+  return cmpxchg(&m->state, 0, 1) == 0 ? 0 : -1;
+}
+
+/* 释放互斥锁，state原来是1说明无人等待，不进入内核 */
+void umutex_unlock(struct umutex* m){
+  if(xchg(&m->state, 0) == 2){
+    futex_wake((uint32_t*)&m->state, 1);
+  }
+}
+
+/* 初始化条件变量 */
+void ucond_init(struct ucond* c){
+  c->seq = 0;
+}
+
+/* 释放m并等待c被signal或broadcast，返回前重新持有m。
+ * 先记下seq再释放m，之后的signal会改变seq，futex_wait发现值不符会立即返回，不会错过。
+ * 和其他条件变量一样可能被多余地唤醒，调用者须在循环中重新检查条件 */
+void ucond_wait(struct ucond* c, struct umutex* m){
+  uint32_t seq = c->seq;
+  umutex_unlock(m);
+  futex_wait((uint32_t*)&c->seq, seq);
+  /* 被唤醒的线程往往要等刚唤醒它的线程释放m，直接按有人等待的状态去抢 */
+  while(xchg(&m->state, 2) != 0){
+    futex_wait((uint32_t*)&m->state, 2);
+  }
+}
+
+/* 唤醒一个等待c的线程 */
+void ucond_signal(struct ucond* c){
+  xadd(&c->seq, 1);
+  futex_wake((uint32_t*)&c->seq, 1);
+}
+
+/* 唤醒所有等待c的线程 */
+void ucond_broadcast(struct ucond* c){
+  xadd(&c->seq, 1);
+  futex_wake((uint32_t*)&c->seq, 0xffffffff);
+}
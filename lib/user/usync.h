@@ -0,0 +1,31 @@
+#ifndef __LIB_USER_USYNC_H
+#define __LIB_USER_USYNC_H
+#include "stdint.h"
+
+/********** 用户态互斥锁和条件变量 **********
+ * 基于futex：没有争用时只用一条原子指令，不进入内核，
+ * 有争用时通过futex_wait睡眠，不再忙等
+ * *****************************************/
+
+/* 互斥锁，state为0表示空闲，1表示被持有且无人等待，2表示被持有且可能有人等待 */
+struct umutex{
+  volatile uint32_t state;
+};
+
+/* 条件变量，seq每次signal或broadcast时加1，等待者据此判断是否错过了唤醒 */
+struct ucond{
+  volatile uint32_t seq;
+};
+
+#define UMUTEX_INITIALIZER {0}
+#define UCOND_INITIALIZER {0}
+
+void umutex_init(struct umutex* m);
+void umutex_lock(struct umutex* m);
+int32_t umutex_trylock(struct umutex* m);
+void umutex_unlock(struct umutex* m);
+void ucond_init(struct ucond* c);
+void ucond_wait(struct ucond* c, struct umutex* m);
+void ucond_signal(struct ucond* c);
+void ucond_broadcast(struct ucond* c);
+#endif
@@ -0,0 +1,48 @@
+#include "vdso.h"
+#include "stdint.h"
+
+#define vdso_barrier() asm volatile ("" : : : "memory")
+
+/* 计算a * b / c，商须在32位以内，避免用到libgcc的64位除法 */
+static inline uint32_t mul_div(uint32_t a, uint32_t b, uint32_t c){
+  uint32_t quot, rem;
+  asm ("mull %3; divl %4" : "=a"(quot), "=&d"(rem) : "a"(a), "rm"(b), "rm"(c));
+  return quot;
+}
+
+/* 内核自开中断以来的滴答数，单独一个字的读取是原子的，不必用seqlock */
+uint32_t vdso_ticks(void){
+  return ((struct vdso_data*)VDSO_VADDR)->ticks;
+}
+
+/* 开机以来的微秒数，以最近一次时钟中断为基准，用TSC补上此后经过的时间 */
+uint64_t vdso_clock_us(void){
+  struct vdso_data* vd = (struct vdso_data*)VDSO_VADDR;
+  uint32_t seq, now_ticks, tsc_low, us_per_tick, tsc_per_tick;
+  do{
+    seq = vd->seq;
+    vdso_barrier();             //x86上读读不会乱序，只需防止编译器重排
+    now_ticks = vd->ticks;
+    tsc_low = vd->tsc_low;
+    us_per_tick = vd->us_per_tick;
+    tsc_per_tick = vd->tsc_per_tick;
+    vdso_barrier();
+  }while((seq & 1) || seq != vd->seq);
+
+  uint64_t us = (uint64_t)now_ticks * us_per_tick;
+  if(tsc_per_tick != 0){
+    /* 空闲的CPU会停掉周期时钟，距上次更新可能已有好几个tick */
+    us += mul_div(vdso_rdtsc() - tsc_low, us_per_tick, tsc_per_tick);
+  }
+  return us;
+}
+
+/* 当前进程的pid */
+uint32_t vdso_getpid(void){
+  return ((struct vdso_proc*)VDSO_PROC_VADDR)->pid;
+}
+
+/* 当前进程创建时的ticks */
+uint32_t vdso_start_ticks(void){
+  return ((struct vdso_proc*)VDSO_PROC_VADDR)->start_ticks;
+}
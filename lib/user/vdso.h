@@ -0,0 +1,44 @@
+#ifndef __LIB_USER_VDSO_H
+#define __LIB_USER_VDSO_H
+#include "stdint.h"
+
+/********** 内核数据页 **********
+ * 内核在每个进程的用户地址空间中以只读方式映射两页：
+ * VDSO_VADDR处是全体进程共享的vdso_data，由BSP的时钟中断更新，
+ * 其后一页是本进程的vdso_proc，创建进程时写好，之后不再改变。
+ * 用户态直接读取ticks、时钟和pid，不必进入内核。
+ * vdso_data由seqlock保护：写者在更新前后各把seq加1，
+ * 读者在seq为偶数且读取前后不变时才采用读到的值
+ * ******************************/
+#define VDSO_VADDR 0x8046000    //紧挨在USER_VADDR_START之下，不在进程的虚拟地址池中
+#define VDSO_PROC_VADDR (VDSO_VADDR + 0x1000)
+
+/* 全体进程共享的数据 */
+struct vdso_data{
+  volatile uint32_t seq;        //为奇数时正在更新
+  uint32_t ticks;               //与内核的ticks相同
+  uint32_t tsc_low;             //ticks更新时TSC的低32位
+  uint32_t hz;                  //每秒的ticks数
+  uint32_t us_per_tick;
+  uint32_t tsc_per_tick;        //校准得到的每个tick的TSC周期数，为0表示没有TSC，时钟只精确到tick
+};
+
+/* 进程的常量 */
+struct vdso_proc{
+  int16_t pid;                  //进程号，同一进程的线程相同
+  uint16_t pad;
+  uint32_t start_ticks;         //创建进程时的ticks
+};
+
+/* 读TSC的低32位，各CPU的TSC假定是同步的 */
+static inline uint32_t vdso_rdtsc(void){
+  uint32_t low, high;
+  asm volatile ("rdtsc" : "=a"(low), "=d"(high));
+  return low;
+}
+
+uint32_t vdso_ticks(void);
+uint64_t vdso_clock_us(void);
+uint32_t vdso_getpid(void);
+uint32_t vdso_start_ticks(void);
+#endif
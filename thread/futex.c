@@ -0,0 +1,100 @@
+#include "futex.h"
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+#include "thread.h"
+#include "interrupt.h"
+#include "spinlock.h"
+#include "debug.h"
+
+/* 哈希桶，同一个桶中的等待者按到达顺序排列 */
+struct futex_bucket{
+  struct spinlock lock;
+  struct list waiters;
+};
+
+/* 等待者，放在等待线程自己的内核栈上，被唤醒前不会失效 */
+struct futex_waiter{
+  struct list_elem tag;
+  struct mm_struct* mm;         //所在的地址空间，同一进程的线程共享
+  uint32_t* uaddr;
+  struct task_struct* thread;
+};
+
+static struct futex_bucket buckets[FUTEX_BUCKETS];
+
+/* 计算(mm, uaddr)所在的哈希桶，uaddr至少4字节对齐，故先去掉低2位 */
+static struct futex_bucket* futex_hash(struct mm_struct* mm, uint32_t* uaddr){
+  uint32_t key = ((uint32_t)uaddr >> 2) ^ ((uint32_t)mm >> 12);
+  return &buckets[(key * 2654435761u) >> (32 - FUTEX_HASH_BITS)];
+}
+
+/* 地址须在用户空间并且4字节对齐 */
+static bool futex_addr_ok(uint32_t* uaddr){
+  return uaddr != NULL && ((uint32_t)uaddr & 3) == 0 && (uint32_t)uaddr < 0xc0000000;
+}
+
+/* 初始化所有哈希桶 */
+void futex_init(void){
+  uint32_t idx;
+  for(idx = 0; idx < FUTEX_BUCKETS; idx++){
+    spin_lock_init(&buckets[idx].lock);
+    list_init(&buckets[idx].waiters);
+  }
+}
+
+/* 系统调用futex_wait，*uaddr仍等于val时睡眠，直到被futex_wake唤醒，返回0，
+ * 值已经变了说明释放者已经来过，直接返回-1，由用户态重新检查。
+ * 检查值和排队都在桶锁内完成，释放者改值后再唤醒，不会错过唤醒 */
+int32_t sys_futex_wait(uint32_t* uaddr, uint32_t val){
+  if(!futex_addr_ok(uaddr)){
+    return -1;
+  }
+  struct task_struct* cur = running_thread();
+  struct futex_waiter waiter;
+  waiter.mm = cur->mm;
+  waiter.uaddr = uaddr;
+  waiter.thread = cur;
+  struct futex_bucket* bucket = futex_hash(cur->mm, uaddr);
+  enum intr_status old_status = spin_lock_irqsave(&bucket->lock);
+  if(*(volatile uint32_t*)uaddr != val){
+    spin_unlock_irqrestore(&bucket->lock, old_status);
+    return -1;
+  }
+  list_append(&bucket->waiters, &waiter.tag);
+  thread_block_unlock(TASK_BLOCKED, &bucket->lock);
+  intr_set_status(old_status);
+  return 0;
+}
+
+/* 系统调用futex_wake，最多唤醒cnt个在uaddr上等待的线程，返回唤醒的个数 */
+int32_t sys_futex_wake(uint32_t* uaddr, uint32_t cnt){
+  if(!futex_addr_ok(uaddr)){
+    return -1;
+  }
+  struct task_struct* cur = running_thread();
+  struct futex_bucket* bucket = futex_hash(cur->mm, uaddr);
+  struct list woken;
+  int32_t woken_cnt = 0;
+  list_init(&woken);
+  enum intr_status old_status = spin_lock_irqsave(&bucket->lock);
+  struct list_elem* elem = bucket->waiters.head.next;
+  while(elem != &bucket->waiters.tail && (uint32_t)woken_cnt < cnt){
+    struct list_elem* next = elem->next;
+    struct futex_waiter* waiter = elem2entry(struct futex_waiter, tag, elem);
+    if(waiter->mm == cur->mm && waiter->uaddr == uaddr){
+      list_remove(elem);
+      list_append(&woken, elem);
+      woken_cnt++;
+    }
+    elem = next;
+  }
+  spin_unlock(&bucket->lock);
+  /* 在桶锁外唤醒，等待者已从桶中摘下，不会再被别人唤醒 */
+  while(!list_empty(&woken)){
+    struct futex_waiter* waiter = elem2entry(struct futex_waiter, tag, list_pop(&woken));
+    thread_unblock(waiter->thread);
+  }
+  intr_set_status(old_status);
+  return woken_cnt;
+}
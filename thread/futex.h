@@ -0,0 +1,18 @@
+#ifndef __THREAD_FUTEX_H
+#define __THREAD_FUTEX_H
+#include "stdint.h"
+#include "global.h"
+
+/********** futex **********
+ * 用户态同步原语的内核部分，以用户虚拟地址上的一个32位整数为键：
+ * 用户态通过原子指令修改这个整数，没有争用时不进入内核，
+ * 有争用时调用futex_wait睡眠，由释放者调用futex_wake唤醒。
+ * 同一地址在不同进程中是不同的futex，因此键为(地址空间, 地址)，同一进程的线程共享
+ * *************************/
+#define FUTEX_HASH_BITS 6
+#define FUTEX_BUCKETS (1 << FUTEX_HASH_BITS)
+
+void futex_init(void);
+int32_t sys_futex_wait(uint32_t* uaddr, uint32_t val);
+int32_t sys_futex_wake(uint32_t* uaddr, uint32_t cnt);
+#endif
@@ -0,0 +1,92 @@
+#include "pid.h"
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+#include "bitmap.h"
+#include "thread.h"
+#include "interrupt.h"
+#include "spinlock.h"
+#include "debug.h"
+
+static uint8_t pid_bits[PID_MAX / 8];
+static struct bitmap pid_bitmap;            //已分配的pid
+static pid_t last_pid;                      //上次分配的pid，从其后开始查找
+static struct list pid_hash[PID_HASH_BUCKETS];
+static struct spinlock pid_lock;            //保护位图、last_pid和哈希表
+
+/* 初始化pid位图和哈希表，0号pid保留不用 */
+void pid_init(void){
+  pid_bitmap.btmp_bytes_len = PID_MAX / 8;
+  pid_bitmap.bits = pid_bits;
+  bitmap_init(&pid_bitmap);
+  bitmap_set(&pid_bitmap, 0, 1);
+  last_pid = 0;
+  uint32_t idx;
+  for(idx = 0; idx < PID_HASH_BUCKETS; idx++){
+    list_init(&pid_hash[idx]);
+  }
+  spin_lock_init(&pid_lock);
+}
+
+/* 从start开始循环查找空闲的pid，以字节为单位跳过全满的部分，没有时返回-1 */
+static int32_t pid_scan(uint32_t start){
+  uint32_t scanned = 0, bit_idx = start;
+  while(scanned < PID_MAX){
+    if(bit_idx % 8 == 0 && pid_bits[bit_idx / 8] == 0xff && scanned + 8 <= PID_MAX){
+      bit_idx = (bit_idx + 8) % PID_MAX;
+      scanned += 8;
+      continue;
+    }
+    if(!bitmap_scan_test(&pid_bitmap, bit_idx)){
+      return bit_idx;
+    }
+    bit_idx = (bit_idx + 1) % PID_MAX;
+    scanned++;
+  }
+  return -1;
+}
+
+/* 为pthread分配pid并加入哈希表，pid用完时返回-1 */
+pid_t pid_alloc(struct task_struct* pthread){
+  enum intr_status old_status = spin_lock_irqsave(&pid_lock);
+  int32_t pid = pid_scan((last_pid + 1) % PID_MAX);
+  pthread->pid = pid;
+  if(pid >= 0){
+    bitmap_set(&pid_bitmap, pid, 1);
+    last_pid = pid;
+    list_append(&pid_hash[pid & (PID_HASH_BUCKETS - 1)], &pthread->pid_tag);
+  }
+  spin_unlock_irqrestore(&pid_lock, old_status);
+  return pid;
+}
+
+/* 回收线程时释放其pid，此后pid_to_task不再能找到它 */
+void pid_free(struct task_struct* pthread){
+  enum intr_status old_status = spin_lock_irqsave(&pid_lock);
+  ASSERT(bitmap_scan_test(&pid_bitmap, pthread->pid));
+  list_remove(&pthread->pid_tag);
+  bitmap_set(&pid_bitmap, pthread->pid, 0);
+  spin_unlock_irqrestore(&pid_lock, old_status);
+}
+
+/* 由pid找到线程，没有时返回NULL。
+ * 返回的PCB在该线程被回收前有效，调用者须自行保证在使用期间它不会被thread_join或回收 */
+struct task_struct* pid_to_task(pid_t pid){
+  if(pid <= 0){
+    return NULL;
+  }
+  struct task_struct* found = NULL;
+  enum intr_status old_status = spin_lock_irqsave(&pid_lock);
+  struct list* bucket = &pid_hash[pid & (PID_HASH_BUCKETS - 1)];
+  struct list_elem* elem = bucket->head.next;
+  while(elem != &bucket->tail){
+    struct task_struct* pthread = elem2entry(struct task_struct, pid_tag, elem);
+    if(pthread->pid == pid){
+      found = pthread;
+      break;
+    }
+    elem = elem->next;
+  }
+  spin_unlock_irqrestore(&pid_lock, old_status);
+  return found;
+}
@@ -0,0 +1,20 @@
+#ifndef __THREAD_PID_H
+#define __THREAD_PID_H
+#include "stdint.h"
+#include "global.h"
+#include "thread.h"
+
+/********** 进程号 **********
+ * 用位图记录已分配的pid，线程回收后其pid可再次分配。
+ * 分配时从上次分配的pid之后找空闲位，刚释放的pid不会马上被复用。
+ * 已分配的pid按哈希串入PID_HASH_BUCKETS个桶，由pid查找线程不必遍历thread_all_list
+ * **************************/
+#define PID_MAX 32768               //pid_t为int16_t，可用的pid为1~PID_MAX-1
+#define PID_HASH_BITS 8
+#define PID_HASH_BUCKETS (1 << PID_HASH_BITS)
+
+void pid_init(void);
+pid_t pid_alloc(struct task_struct* pthread);
+void pid_free(struct task_struct* pthread);
+struct task_struct* pid_to_task(pid_t pid);
+#endif
@@ -0,0 +1,180 @@
+#include "rcu.h"
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+#include "thread.h"
+#include "smp.h"
+#include "interrupt.h"
+#include "spinlock.h"
+#include "softirq.h"
+#include "workqueue.h"
+#include "sync.h"
+#include "debug.h"
+
+static struct spinlock rcu_lock;        //保护以下宽限期状态和回调队列
+static uint32_t gp_started;             //已开始的宽限期数，最近一个的序号
+static uint32_t gp_done;                //已结束的宽限期数，与gp_started相等时没有进行中的宽限期
+static volatile uint32_t qs_pending;    //本宽限期中还未经过静止状态的CPU，第n位对应n号CPU
+static struct list cb_list;             //等待宽限期结束的回调，按gp从小到大排列
+static struct list done_list;           //宽限期已结束、待执行的回调
+static struct work_struct rcu_work;     //在工作线程中执行done_list中的回调
+
+/* 开始新的宽限期，须持rcu_lock */
+static void rcu_gp_start(void){
+  uint32_t mask = 0, id;
+  for(id = 0; id < cpu_cnt; id++){
+    if(cpus[id].online){
+      mask |= (1 << id);
+    }
+  }
+  gp_started++;
+  qs_pending = mask;
+}
+
+/* 空闲的CPU可能一直停在hlt上而不调度，唤醒它们，让idle线程重新调度一次 */
+static void rcu_kick_idle(void){
+  uint32_t id;
+  for(id = 0; id < cpu_cnt; id++){
+    if(qs_pending & (1 << id)){
+      smp_resched(id);
+    }
+  }
+}
+
+/* RCU软中断，最后一个CPU经过静止状态后在该CPU上处理：
+ * 把已结束宽限期的回调交给工作线程，还有回调在等待时开始下一个宽限期 */
+static void rcu_softirq(void){
+  bool done = false, kick = false;
+  enum intr_status old_status = spin_lock_irqsave(&rcu_lock);
+  while(!list_empty(&cb_list)){
+    struct rcu_head* head = elem2entry(struct rcu_head, tag, cb_list.head.next);
+    if((int32_t)(head->gp - gp_done) > 0){
+      break;
+    }
+    list_remove(&head->tag);
+    list_append(&done_list, &head->tag);
+    done = true;
+  }
+  if(!list_empty(&cb_list) && gp_started == gp_done){
+    rcu_gp_start();
+    kick = true;
+  }
+  spin_unlock_irqrestore(&rcu_lock, old_status);
+  if(done){
+    queue_work(&rcu_work);
+  }
+  if(kick){
+    rcu_kick_idle();
+  }
+}
+
+/* 在工作线程中逐个执行宽限期已结束的回调 */
+static void rcu_do_callbacks(void* arg UNUSED){
+  while(1){
+    enum intr_status old_status = spin_lock_irqsave(&rcu_lock);
+    if(list_empty(&done_list)){
+      spin_unlock_irqrestore(&rcu_lock, old_status);
+      return;
+    }
+    struct rcu_head* head = elem2entry(struct rcu_head, tag, list_pop(&done_list));
+    spin_unlock_irqrestore(&rcu_lock, old_status);
+    head->func(head->arg);
+  }
+}
+
+/* 初始化RCU，须在softirq_init和workqueue_init之后调用 */
+void rcu_init(void){
+  spin_lock_init(&rcu_lock);
+  gp_started = gp_done = 0;
+  qs_pending = 0;
+  list_init(&cb_list);
+  list_init(&done_list);
+  work_init(&rcu_work, rcu_do_callbacks, NULL);
+  open_softirq(SOFTIRQ_RCU, rcu_softirq);
+}
+
+/* 进入读临界区，可以嵌套，中断处理程序中也可以使用 */
+void rcu_read_lock(void){
+  running_thread()->rcu_read_depth++;
+  asm volatile ("" : : : "memory");
+}
+
+/* 离开读临界区，最外层退出时补上在临界区中被推迟的调度 */
+void rcu_read_unlock(void){
+  struct task_struct* cur = running_thread();
+  ASSERT(cur->rcu_read_depth > 0);
+  asm volatile ("" : : : "memory");
+  if(--cur->rcu_read_depth == 0){
+    enum intr_status old_status = intr_disable();
+    if(old_status == INTR_ON && !softirq_active() && this_cpu()->need_resched){
+      schedule();
+    }
+    intr_set_status(old_status);
+  }
+}
+
+/* 由schedule在关中断时调用，记录cpu经过了静止状态，
+ * 没有进行中的宽限期或本CPU已报告过时只读一次qs_pending */
+void rcu_note_context_switch(uint8_t cpu){
+  uint32_t bit = 1 << cpu;
+  if(!(qs_pending & bit)){
+    return;
+  }
+  spin_lock(&rcu_lock);
+  if(qs_pending & bit){
+    qs_pending &= ~bit;
+    if(qs_pending == 0){
+      gp_done = gp_started;
+      raise_softirq(SOFTIRQ_RCU);
+    }
+  }
+  spin_unlock(&rcu_lock);
+}
+
+/* 登记回调，在此之后开始的宽限期结束时由工作线程调用func(arg)，
+ * 可在读临界区和中断处理程序中调用 */
+void call_rcu(struct rcu_head* head, rcu_func* func, void* arg){
+  head->func = func;
+  head->arg = arg;
+  enum intr_status old_status = spin_lock_irqsave(&rcu_lock);
+  /* 进行中的宽限期可能早于调用者摘下数据，须等下一个 */
+  head->gp = gp_started + 1;
+  list_append(&cb_list, &head->tag);
+  bool kick = false;
+  if(gp_started == gp_done){
+    rcu_gp_start();
+    kick = true;
+  }
+  spin_unlock_irqrestore(&rcu_lock, old_status);
+  if(kick){
+    rcu_kick_idle();
+  }
+}
+
+static void rcu_wakeme(void* arg){
+  sema_up(arg);
+}
+
+/* 等待一个完整的宽限期，返回时此前开始的读临界区都已结束。
+ * 会阻塞，不能在读临界区、中断处理程序和工作线程中调用 */
+void synchronize_rcu(void){
+  ASSERT(running_thread()->rcu_read_depth == 0);
+  struct semaphore done;
+  struct rcu_head head;
+  sema_init(&done, 0);
+  call_rcu(&head, rcu_wakeme, &done);
+  sema_down(&done);
+}
+
+/* list_traversal的RCU版本，调用者须处于读临界区，返回的节点在退出读临界区前有效 */
+struct list_elem* list_traversal_rcu(struct list* plist, function func, int arg){
+  ASSERT(running_thread()->rcu_read_depth > 0);
+  struct list_elem* elem = rcu_dereference(plist->head.next);
+  while(elem != &plist->tail){
+    if(func(elem, arg)){
+      return elem;
+    }
+    elem = rcu_dereference(elem->next);
+  }
+  return NULL;
+}
@@ -0,0 +1,59 @@
+#ifndef __THREAD_RCU_H
+#define __THREAD_RCU_H
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+
+/********** RCU **********
+ * 用于读多写少的数据：读者不加锁，只用rcu_read_lock/rcu_read_unlock标出读临界区，
+ * 临界区中不会被抢占，也不能阻塞；写者之间仍用锁互斥，用指针替换发布新数据或摘下旧数据，
+ * 旧数据等过一个宽限期后再释放。
+ * CPU在schedule中调度一次即经过了静止状态，此时它不在任何读临界区中，
+ * 宽限期开始时在线的CPU都经过静止状态后宽限期结束，此前摘下的数据已没有读者引用。
+ * 回调由工作线程执行，可以阻塞
+ * ************************/
+typedef void rcu_func(void* arg);
+
+struct rcu_head{
+  struct list_elem tag;     //在回调队列中的节点
+  rcu_func* func;
+  void* arg;
+  uint32_t gp;              //要等待结束的宽限期序号
+};
+
+/* 读者读取要发布的指针，x86不会把依赖于该指针的读提前，只需防止编译器合并或重排 */
+#define rcu_dereference(p) (*(__typeof__(p) volatile*)&(p))
+
+/* 写者发布指针，x86的写操作不会与之前的写重排，编译器屏障保证对象先初始化好 */
+#define rcu_assign_pointer(p, v) do{ \
+    asm volatile ("" : : : "memory"); \
+    *(__typeof__(p) volatile*)&(p) = (v); \
+  }while(0)
+
+/* 把elem发布到plist队尾，先填好elem自己的指针，再让前一个节点指向它，
+ * 写者之间须互斥 */
+static inline void list_append_rcu(struct list* plist, struct list_elem* elem){
+  struct list_elem* last = plist->tail.prev;
+  elem->prev = last;
+  elem->next = &plist->tail;
+  elem->owner = plist;
+  rcu_assign_pointer(last->next, elem);
+  plist->tail.prev = elem;
+}
+
+/* 摘下elem，保留elem->next，正在elem上的读者仍能继续向后遍历，
+ * elem须过一个宽限期后才能释放或再次加入链表，写者之间须互斥 */
+static inline void list_remove_rcu(struct list_elem* elem){
+  rcu_assign_pointer(elem->prev->next, elem->next);
+  elem->next->prev = elem->prev;
+  elem->owner = NULL;
+}
+
+void rcu_init(void);
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+void rcu_note_context_switch(uint8_t cpu);
+void call_rcu(struct rcu_head* head, rcu_func* func, void* arg);
+void synchronize_rcu(void);
+struct list_elem* list_traversal_rcu(struct list* plist, function func, int arg);
+#endif
@@ -0,0 +1,443 @@
+#include "sched.h"
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+#include "rbtree.h"
+#include "thread.h"
+#include "interrupt.h"
+#include "debug.h"
+#include "timer.h"
+#include "spinlock.h"
+#include "smp.h"
+
+/* 每个CPU一个运行队列 */
+struct runqueue{
+  struct spinlock lock;
+  struct list queues[MLFQ_LEVELS];  //MLFQ类每个级别一个就绪队列
+  uint32_t bitmap;                  //第n位为1表示第n级队列非空
+  struct rb_root fair_tree;         //公平类的就绪线程，按vruntime排序
+  struct rb_node* fair_leftmost;    //vruntime最小的节点，缓存下来免得每次从根找起
+  uint32_t fair_load;               //公平类就绪线程的权重之和
+  uint32_t fair_nr;                 //公平类就绪线程数
+  uint32_t min_vruntime;            //公平类的vruntime基准，只增不减，新加入的线程以此为参照
+  volatile uint32_t nr_ready;       //就绪线程总数，选择CPU和窃取时参考
+  uint32_t last_boost;              //上次全局提升时的ticks
+};
+
+static struct runqueue runqueues[MAX_CPUS];
+
+/* 各级别的时间片，级别越低时间片越长 */
+static const uint8_t level_slice[MLFQ_LEVELS] = {2, 4, 6, 8, 12, 16, 24, 32};
+
+/* 由线程的基础优先级priority得到其所能到达的最高级别，priority越大级别越高 */
+static uint8_t top_level(struct task_struct* pthread){
+  uint8_t prio = pthread->priority > 31 ? 31 : pthread->priority;
+  return (31 - prio) * MLFQ_LEVELS / 32;
+}
+
+/* 返回位图中最低的置位下标，也就是最高的非空级别，调用前需确保位图非0 */
+static uint32_t first_set_bit(uint32_t bitmap){
+  uint32_t idx;
+  asm ("bsfl %1, %0" : "=r"(idx) : "rm"(bitmap));
+  return idx;
+}
+
+/* vruntime会回绕，用差值的符号比较先后 */
+static bool vruntime_before(uint32_t a, uint32_t b){
+  return (int32_t)(a - b) < 0;
+}
+
+/* 初始化所有CPU的就绪队列 */
+void sched_init(void){
+  uint32_t cpu, level;
+  for(cpu = 0; cpu < MAX_CPUS; cpu++){
+    struct runqueue* rq = &runqueues[cpu];
+    spin_lock_init(&rq->lock);
+    for(level = 0; level < MLFQ_LEVELS; level++){
+      list_init(&rq->queues[level]);
+    }
+    rq->bitmap = 0;
+    rb_init(&rq->fair_tree);
+    rq->fair_leftmost = NULL;
+    rq->fair_load = rq->fair_nr = 0;
+    rq->min_vruntime = 0;
+    rq->nr_ready = 0;
+    rq->last_boost = 0;
+  }
+}
+
+/* 初始化新线程的调度信息，默认属于公平类，vruntime在放入就绪队列时再确定 */
+void sched_task_init(struct task_struct* pthread){
+  pthread->policy = SCHED_FAIR;
+  pthread->weight = (pthread->priority + 1) * FAIR_WEIGHT_UNIT;
+  pthread->vruntime = 0;
+  pthread->on_rq = false;
+  pthread->mlfq_level = top_level(pthread);
+  pthread->ticks = level_slice[pthread->mlfq_level];
+}
+
+/* 更改不在就绪队列中的线程（正在运行或尚未加入）的调度类，直接修改即可 */
+void sched_task_setpolicy(struct task_struct* pthread, enum sched_policy policy){
+  ASSERT(!pthread->on_rq);
+  pthread->policy = policy;
+  if(policy == SCHED_MLFQ){
+    pthread->mlfq_level = top_level(pthread);
+    pthread->ticks = level_slice[pthread->mlfq_level];
+  }
+}
+
+/* 更改当前线程的调度类 */
+void sched_setpolicy(enum sched_policy policy){
+  sched_task_setpolicy(running_thread(), policy);
+}
+
+/* 系统调用setpolicy，交互或频繁等待I/O的线程可改用SCHED_MLFQ以获得更短的响应时间，
+ * 成功返回0，policy无效返回-1 */
+int32_t sys_setpolicy(uint32_t policy){
+  if(policy != SCHED_FAIR && policy != SCHED_MLFQ){
+    return -1;
+  }
+  sched_setpolicy(policy);
+  return 0;
+}
+
+/* 以下函数须持有rq->lock */
+
+/* 把pthread按vruntime插入红黑树，vruntime过小的（刚被唤醒或新建的）先提到基准附近 */
+static void fair_add(struct runqueue* rq, struct task_struct* pthread){
+  uint32_t floor = rq->min_vruntime - FAIR_WAKEUP_CREDIT;
+  if(vruntime_before(pthread->vruntime, floor)){
+    pthread->vruntime = floor;
+  }
+  struct rb_node** link = &rq->fair_tree.node, *parent = NULL;
+  bool leftmost = true;
+  while(*link != NULL){
+    parent = *link;
+    struct task_struct* entry = elem2entry(struct task_struct, fair_node, parent);
+    /* vruntime相同时排在后面，保持先来先服务 */
+    if(vruntime_before(pthread->vruntime, entry->vruntime)){
+      link = &parent->left;
+    }else{
+      link = &parent->right;
+      leftmost = false;
+    }
+  }
+  rb_link_node(&pthread->fair_node, parent, link);
+  rb_insert_color(&pthread->fair_node, &rq->fair_tree);
+  if(leftmost){
+    rq->fair_leftmost = &pthread->fair_node;
+  }
+  rq->fair_load += pthread->weight;
+  rq->fair_nr++;
+}
+
+static void fair_del(struct runqueue* rq, struct task_struct* pthread){
+  if(rq->fair_leftmost == &pthread->fair_node){
+    rq->fair_leftmost = rb_next(&pthread->fair_node);
+  }
+  rb_erase(&pthread->fair_node, &rq->fair_tree);
+  rq->fair_load -= pthread->weight;
+  rq->fair_nr--;
+}
+
+/* 把min_vruntime推进到当前运行线程和最左节点中较小的vruntime，只增不减 */
+static void fair_update_min(struct runqueue* rq, struct task_struct* cur){
+  uint32_t min = rq->min_vruntime;
+  bool found = false;
+  if(cur != NULL && cur->policy == SCHED_FAIR){
+    min = cur->vruntime;
+    found = true;
+  }
+  if(rq->fair_leftmost != NULL){
+    struct task_struct* left = elem2entry(struct task_struct, fair_node, rq->fair_leftmost);
+    if(!found || vruntime_before(left->vruntime, min)){
+      min = left->vruntime;
+      found = true;
+    }
+  }
+  if(found && vruntime_before(rq->min_vruntime, min)){
+    rq->min_vruntime = min;
+  }
+}
+
+/* pthread这次能运行的时间片：调度周期按权重分得的份额 */
+static uint8_t fair_slice(struct runqueue* rq, struct task_struct* pthread){
+  uint32_t nr = rq->fair_nr + 1;
+  uint32_t period = FAIR_LATENCY_TICKS;
+  if(nr * FAIR_MIN_GRAN_TICKS > period){
+    period = nr * FAIR_MIN_GRAN_TICKS;
+  }
+  uint32_t slice = period * pthread->weight / (rq->fair_load + pthread->weight);
+  if(slice < FAIR_MIN_GRAN_TICKS){
+    slice = FAIR_MIN_GRAN_TICKS;
+  }
+  return slice > 255 ? 255 : slice;
+}
+
+static void rq_add(struct runqueue* rq, struct task_struct* pthread){
+  if(pthread->policy == SCHED_FAIR){
+    fair_add(rq, pthread);
+  }else{
+    struct list* queue = &rq->queues[pthread->mlfq_level];
+    ASSERT(!elem_on_list(queue, &pthread->general_tag));
+    list_append(queue, &pthread->general_tag);
+    rq->bitmap |= (1 << pthread->mlfq_level);
+  }
+  pthread->on_rq = true;
+  rq->nr_ready++;
+}
+
+static void rq_del(struct runqueue* rq, struct task_struct* pthread){
+  if(pthread->policy == SCHED_FAIR){
+    fair_del(rq, pthread);
+  }else{
+    list_remove(&pthread->general_tag);
+    if(list_empty(&rq->queues[pthread->mlfq_level])){
+      rq->bitmap &= ~(1 << pthread->mlfq_level);
+    }
+  }
+  pthread->on_rq = false;
+  rq->nr_ready--;
+}
+
+/* 先从MLFQ类最高的非空级别中取，没有再取公平类中vruntime最小的，
+ * 窃取时要跳过还在其CPU上没有切换出去的线程 */
+static struct task_struct* rq_pick(struct runqueue* rq, bool skip_on_cpu){
+  uint32_t bitmap = rq->bitmap;
+  while(bitmap != 0){
+    uint32_t level = first_set_bit(bitmap);
+    struct list_elem* elem = rq->queues[level].head.next;
+    while(elem != &rq->queues[level].tail){
+      struct task_struct* pthread = elem2entry(struct task_struct, general_tag, elem);
+      if(!skip_on_cpu || !pthread->on_cpu){
+        rq_del(rq, pthread);
+        return pthread;
+      }
+      elem = elem->next;
+    }
+    bitmap &= ~(1 << level);
+  }
+  struct rb_node* node = rq->fair_leftmost;
+  while(node != NULL){
+    struct task_struct* pthread = elem2entry(struct task_struct, fair_node, node);
+    if(!skip_on_cpu || !pthread->on_cpu){
+      rq_del(rq, pthread);
+      pthread->ticks = fair_slice(rq, pthread);
+      return pthread;
+    }
+    node = rb_next(node);
+  }
+  return NULL;
+}
+
+/* busy的队列中积压了就绪线程时唤醒一个空闲的CPU来窃取，
+ * 空闲的AP停掉了周期时钟，不唤醒要等到其单次触发到期才会去窃取 */
+static void sched_kick_idle(uint8_t busy){
+  uint8_t self = cpu_id(), id;
+  for(id = 0; id < MAX_CPUS; id++){
+    if(id != busy && id != self && cpus[id].online && cpus[id].curr == cpus[id].idle){
+      smp_resched(id);
+      return;
+    }
+  }
+}
+
+/* 把pthread加入pthread->cpu的运行队列中，队列中多于一个就绪线程时让空闲的CPU分担 */
+void sched_enqueue(struct task_struct* pthread){
+  ASSERT(intr_get_status() == INTR_OFF);
+  struct runqueue* rq = &runqueues[pthread->cpu];
+  spin_lock(&rq->lock);
+  rq_add(rq, pthread);
+  bool backlog = rq->nr_ready > 1;
+  spin_unlock(&rq->lock);
+  if(backlog && cpu_cnt > 1){
+    sched_kick_idle(pthread->cpu);
+  }
+}
+
+/* 从就绪线程最多的其他CPU上窃取一个线程 */
+static struct task_struct* sched_steal(uint8_t cpu){
+  uint8_t victim = cpu, id;
+  uint32_t most = 0;
+  for(id = 0; id < MAX_CPUS; id++){
+    if(id != cpu && cpus[id].online && runqueues[id].nr_ready > most){
+      most = runqueues[id].nr_ready;
+      victim = id;
+    }
+  }
+  if(victim == cpu){
+    return NULL;
+  }
+  struct runqueue* rq = &runqueues[victim];
+  spin_lock(&rq->lock);
+  struct task_struct* pthread = rq_pick(rq, true);
+  uint32_t src_min = rq->min_vruntime;
+  spin_unlock(&rq->lock);
+  if(pthread != NULL){
+    /* vruntime是相对于各自队列的min_vruntime而言的，换到本CPU的基准上 */
+    if(pthread->policy == SCHED_FAIR){
+      pthread->vruntime = pthread->vruntime - src_min + runqueues[cpu].min_vruntime;
+    }
+    pthread->cpu = cpu;
+  }
+  return pthread;
+}
+
+/* 为cpu选出下一个线程，本地队列为空时从其他CPU窃取，都没有时返回NULL */
+struct task_struct* sched_pick_next(uint8_t cpu){
+  ASSERT(intr_get_status() == INTR_OFF);
+  struct runqueue* rq = &runqueues[cpu];
+  struct task_struct* next = NULL;
+  if(rq->nr_ready != 0){
+    spin_lock(&rq->lock);
+    /* 本地队列中on_cpu为1的只可能是本CPU当前的线程，无需跳过 */
+    next = rq_pick(rq, false);
+    fair_update_min(rq, next);
+    spin_unlock(&rq->lock);
+  }
+  if(next == NULL && cpu_cnt > 1){
+    next = sched_steal(cpu);
+  }
+  return next;
+}
+
+/* 判断cpu是否没有就绪线程 */
+bool sched_ready_empty(uint8_t cpu){
+  return runqueues[cpu].nr_ready == 0;
+}
+
+/* 为新线程选择CPU：取就绪线程数加上正在运行的非idle线程数最少的，相同时优先当前CPU */
+uint8_t sched_select_cpu(void){
+  uint8_t best = cpu_id(), id;
+  uint32_t best_load = 0xffffffff;
+  for(id = 0; id < MAX_CPUS; id++){
+    uint8_t cpu = (best + id) % MAX_CPUS;
+    if(!cpus[cpu].online){
+      continue;
+    }
+    uint32_t load = runqueues[cpu].nr_ready + (cpus[cpu].curr != cpus[cpu].idle);
+    if(load < best_load){
+      best_load = load;
+      best = cpu;
+    }
+  }
+  return best;
+}
+
+/* pthread用完了时间片，MLFQ类降一级并重新装填时间片，公平类在下次被选中时再分配 */
+void sched_expire(struct task_struct* pthread){
+  if(pthread->policy != SCHED_MLFQ){
+    return;
+  }
+  if(pthread->mlfq_level < MLFQ_LEVELS - 1){
+    pthread->mlfq_level++;
+  }
+  pthread->ticks = level_slice[pthread->mlfq_level];
+}
+
+/* pthread从阻塞中被唤醒，MLFQ类若时间片还剩一半以上说明它多半在等待I/O，升一级，
+ * 公平类在放入红黑树时调整vruntime */
+void sched_wakeup(struct task_struct* pthread){
+  if(pthread->policy != SCHED_MLFQ){
+    return;
+  }
+  if(pthread->ticks * 2 >= level_slice[pthread->mlfq_level]){
+    if(pthread->mlfq_level > top_level(pthread)){
+      pthread->mlfq_level--;
+    }
+    pthread->ticks = level_slice[pthread->mlfq_level];
+  }
+}
+
+/* 把pthread的当前优先级改为prio，用于优先级继承，须关中断。
+ * pthread可能在任意CPU上运行、就绪或阻塞，
+ * 在就绪队列中时要先摘下来，改完权重和级别再按新值放回去 */
+void sched_set_prio(struct task_struct* pthread, uint8_t prio){
+  ASSERT(intr_get_status() == INTR_OFF);
+  struct runqueue* rq;
+  /* 加锁期间pthread可能被其他CPU窃取，锁到的不是它所在的队列就重来 */
+  while(1){
+    rq = &runqueues[pthread->cpu];
+    spin_lock(&rq->lock);
+    if(rq == &runqueues[pthread->cpu]){
+      break;
+    }
+    spin_unlock(&rq->lock);
+  }
+  bool queued = pthread->on_rq;
+  if(queued){
+    rq_del(rq, pthread);
+  }
+  bool raise = prio > pthread->priority;
+  pthread->priority = prio;
+  pthread->weight = (prio + 1) * FAIR_WEIGHT_UNIT;
+  /* 提高时直接升到新的最高级别，降低时不能停留在新优先级到不了的级别 */
+  if(raise || pthread->mlfq_level < top_level(pthread)){
+    pthread->mlfq_level = top_level(pthread);
+  }
+  if(queued){
+    rq_add(rq, pthread);
+  }
+  spin_unlock(&rq->lock);
+}
+
+/* 判断刚被唤醒放入队列的pthread是否应该抢占其CPU上正在运行的线程：
+ * MLFQ类优先于公平类，MLFQ类比较级别，公平类比较vruntime。
+ * 读的是其他CPU当前线程的字段，不加锁，偶尔判断错只是早一点或晚一点调度 */
+bool sched_wakeup_preempt(struct task_struct* pthread){
+  struct cpu* cpu = &cpus[pthread->cpu];
+  struct task_struct* curr = cpu->curr;
+  if(curr == cpu->idle){
+    return true;
+  }
+  if(curr->policy != pthread->policy){
+    return pthread->policy == SCHED_MLFQ;
+  }
+  if(pthread->policy == SCHED_MLFQ){
+    return pthread->mlfq_level < curr->mlfq_level;
+  }
+  return vruntime_before(pthread->vruntime + FAIR_WAKEUP_GRAN, curr->vruntime);
+}
+
+/* 把rq中所有MLFQ类的就绪线程和当前线程提回各自的最高级别，须持有rq->lock */
+static void sched_boost(struct runqueue* rq, struct task_struct* cur){
+  struct list pending;
+  uint32_t level;
+  list_init(&pending);
+  /* 先把1级及以下的队列摘到pending中，避免放回同一级别时重复处理 */
+  for(level = 1; level < MLFQ_LEVELS; level++){
+    while(!list_empty(&rq->queues[level])){
+      list_append(&pending, list_pop(&rq->queues[level]));
+      rq->nr_ready--;
+    }
+    rq->bitmap &= ~(1 << level);
+  }
+  while(!list_empty(&pending)){
+    struct task_struct* pthread = elem2entry(struct task_struct, general_tag, list_pop(&pending));
+    pthread->mlfq_level = top_level(pthread);
+    pthread->ticks = level_slice[pthread->mlfq_level];
+    rq_add(rq, pthread);
+  }
+  cur->mlfq_level = top_level(cur);
+}
+
+/* 各CPU的时钟中断中调用，cur运行了delta个tick：
+ * 公平类累加vruntime，MLFQ类负责本CPU运行队列的周期性全局提升 */
+void sched_tick(struct task_struct* cur, uint32_t delta){
+  ASSERT(intr_get_status() == INTR_OFF);
+  struct runqueue* rq = &runqueues[cur->cpu];
+  bool boost = (ticks - rq->last_boost >= MLFQ_BOOST_TICKS);
+  bool fair = (cur->policy == SCHED_FAIR && cur != cpus[cur->cpu].idle);
+  if(fair){
+    cur->vruntime += delta * FAIR_VRUNTIME_UNIT * FAIR_NICE0_WEIGHT / cur->weight;
+  }else if(!boost){
+    return;
+  }
+  spin_lock(&rq->lock);
+  fair_update_min(rq, fair ? cur : NULL);
+  if(boost){
+    rq->last_boost = ticks;
+    sched_boost(rq, cur);
+  }
+  spin_unlock(&rq->lock);
+}
@@ -0,0 +1,53 @@
+#ifndef __THREAD_SCHED_H
+#define __THREAD_SCHED_H
+#include "stdint.h"
+#include "global.h"
+#include "thread.h"
+
+/* 调度类，每个CPU先运行MLFQ类中的线程，没有时再运行公平类中的线程 */
+enum sched_policy{
+  SCHED_FAIR,       //默认
+  SCHED_MLFQ
+};
+
+/********** 多级反馈队列(MLFQ) **********
+ * 0级优先级最高，时间片最短，
+ * 用完时间片的线程降一级，阻塞后被唤醒且时间片剩余过半的线程升一级，
+ * 每隔MLFQ_BOOST_TICKS把所有就绪线程提回各自的最高级别，防止饥饿。
+ * 每个CPU有自己的一组队列，新线程放到负载最轻的CPU上，被唤醒的线程回到原来的CPU，
+ * 本地队列为空的CPU从就绪线程最多的CPU上窃取线程
+ * *************************************/
+#define MLFQ_LEVELS 8               //优先级级数，不超过32，以便用一个uint32_t做位图
+#define MLFQ_BOOST_TICKS 100        //全局提升的周期，单位为tick
+
+/********** 公平调度(FAIR) **********
+ * 线程按priority换算成权重，运行时按权重折算成虚拟运行时间vruntime，
+ * 就绪线程按vruntime放在红黑树中，每次运行vruntime最小的线程，
+ * 长期来看各线程得到的CPU时间与权重成正比。
+ * 时间片为调度周期按权重分得的份额，就绪线程越多时间片越短，但不短于FAIR_MIN_GRAN_TICKS。
+ * 被唤醒的线程vruntime至少提到队内最小值减去半个调度周期，
+ * 既能较快得到运行，又不会因为睡得久而长期霸占CPU
+ * **********************************/
+#define FAIR_WEIGHT_UNIT 32         //priority每加1增加的权重
+#define FAIR_NICE0_WEIGHT 1024      //priority为31时的权重
+#define FAIR_VRUNTIME_UNIT 1024     //权重为FAIR_NICE0_WEIGHT的线程运行1个tick增加的vruntime
+#define FAIR_LATENCY_TICKS 6        //调度周期，即所有就绪线程各运行一次的目标时长
+#define FAIR_MIN_GRAN_TICKS 1       //最短时间片
+#define FAIR_WAKEUP_CREDIT (FAIR_LATENCY_TICKS * FAIR_VRUNTIME_UNIT / 2)
+#define FAIR_WAKEUP_GRAN FAIR_VRUNTIME_UNIT     //被唤醒的线程vruntime至少要小这么多才抢占，避免频繁切换
+
+void sched_init(void);
+void sched_task_init(struct task_struct* pthread);
+void sched_task_setpolicy(struct task_struct* pthread, enum sched_policy policy);
+void sched_setpolicy(enum sched_policy policy);
+int32_t sys_setpolicy(uint32_t policy);
+void sched_enqueue(struct task_struct* pthread);
+struct task_struct* sched_pick_next(uint8_t cpu);
+bool sched_ready_empty(uint8_t cpu);
+uint8_t sched_select_cpu(void);
+void sched_expire(struct task_struct* pthread);
+void sched_wakeup(struct task_struct* pthread);
+void sched_set_prio(struct task_struct* pthread, uint8_t prio);
+bool sched_wakeup_preempt(struct task_struct* pthread);
+void sched_tick(struct task_struct* cur, uint32_t delta);
+#endif
@@ -0,0 +1,108 @@
+#include "spinlock.h"
+#include "stdint.h"
+#include "global.h"
+#include "interrupt.h"
+#include "debug.h"
+
+/* 取出slock中当前叫到的号和下一个要发出的号 */
+#define TICKET_OWNER(slock) ((uint16_t)(slock))
+#define TICKET_NEXT(slock)  ((uint16_t)((slock) >> TICKET_SHIFT))
+
+/* 初始化自旋锁 */
+void spin_lock_init(struct spinlock* lock){
+  lock->slock = 0;
+}
+
+/* 获取自旋锁，取号后只读地等待叫号，不再对锁所在的缓存行发起写操作 */
+void spin_lock(struct spinlock* lock){
+  ASSERT(intr_get_status() == INTR_OFF);
+  uint16_t ticket = TICKET_NEXT(atomic_xadd(&lock->slock, 1 << TICKET_SHIFT));
+  while(TICKET_OWNER(lock->slock) != ticket){
+    cpu_relax();
+  }
+}
+
+/* 尝试获取自旋锁，只有没人持有也没人排队时才取号，成功返回true */
+bool spin_trylock(struct spinlock* lock){
+  ASSERT(intr_get_status() == INTR_OFF);
+  uint32_t old = lock->slock;
+  if(TICKET_OWNER(old) != TICKET_NEXT(old)){
+    return false;
+  }
+  return atomic_cmpxchg(&lock->slock, old, old + (1 << TICKET_SHIFT)) == old;
+}
+
+/* 释放自旋锁，叫下一个号。
+ * 只有持锁者会改低16位，16位的写不会覆盖其他CPU同时对高16位的取号，
+ * x86的写操作不会与之前的读写重排，编译器屏障即可 */
+void spin_unlock(struct spinlock* lock){
+  ASSERT(spin_is_locked(lock));
+  asm volatile ("addw $1, %0" : "+m"(*(volatile uint16_t*)&lock->slock) : : "memory");
+}
+
+/* 判断锁是否被持有 */
+bool spin_is_locked(struct spinlock* lock){
+  uint32_t slock = lock->slock;
+  return TICKET_OWNER(slock) != TICKET_NEXT(slock);
+}
+
+/* 关中断后获取自旋锁，返回关中断之前的中断状态 */
+enum intr_status spin_lock_irqsave(struct spinlock* lock){
+  enum intr_status old_status = do_intr_disable(__builtin_return_address(0));
+  spin_lock(lock);
+  return old_status;
+}
+
+/* 释放自旋锁并恢复为old_status */
+void spin_unlock_irqrestore(struct spinlock* lock, enum intr_status old_status){
+  spin_unlock(lock);
+  do_intr_set_status(old_status, __builtin_return_address(0));
+}
+
+/* 初始化MCS锁 */
+void mcs_lock_init(struct mcs_lock* lock){
+  lock->tail = NULL;
+}
+
+/* 获取MCS锁，把node挂到队尾，前面有节点时在node自己的locked上自旋 */
+void mcs_lock(struct mcs_lock* lock, struct mcs_node* node){
+  ASSERT(intr_get_status() == INTR_OFF);
+  node->next = NULL;
+  node->locked = 1;
+  struct mcs_node* prev = (struct mcs_node*)atomic_xchg((volatile uint32_t*)&lock->tail, (uint32_t)node);
+  if(prev == NULL){
+    return;
+  }
+  prev->next = node;
+  while(node->locked){
+    cpu_relax();
+  }
+}
+
+/* 释放MCS锁，node须是获取时用的节点 */
+void mcs_unlock(struct mcs_lock* lock, struct mcs_node* node){
+  if(node->next == NULL){
+    /* 自己是队尾就把锁置空，否则有节点刚换上队尾，等它把自己链到node后面 */
+    if(atomic_cmpxchg((volatile uint32_t*)&lock->tail, (uint32_t)node, 0) == (uint32_t)node){
+      return;
+    }
+    while(node->next == NULL){
+      cpu_relax();
+    }
+  }
+  asm volatile ("" : : : "memory");
+  node->next->locked = 0;
+}
+
+/* 关中断后获取MCS锁，返回关中断之前的中断状态 */
+enum intr_status mcs_lock_irqsave(struct mcs_lock* lock, struct mcs_node* node){
+  enum intr_status old_status = do_intr_disable(__builtin_return_address(0));
+  mcs_lock(lock, node);
+  return old_status;
+}
+
+/* 释放MCS锁并恢复为old_status */
+void mcs_unlock_irqrestore(struct mcs_lock* lock, struct mcs_node* node, enum intr_status old_status){
+  mcs_unlock(lock, node);
+  do_intr_set_status(old_status, __builtin_return_address(0));
+}
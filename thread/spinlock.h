@@ -0,0 +1,68 @@
+#ifndef __THREAD_SPINLOCK_H
+#define __THREAD_SPINLOCK_H
+#include "stdint.h"
+#include "global.h"
+#include "interrupt.h"
+
+/********** 自旋锁 **********
+ * 用于保护多个CPU共享的短临界区，
+ * 持锁期间必须关中断，否则本CPU上的中断处理程序再次申请同一把锁会死锁，
+ * 持锁期间不能阻塞。
+ * spinlock是排队(ticket)锁：申请者原子地取一个号，等叫号叫到自己，按申请顺序获得锁，
+ * 不会有CPU一直抢不到。
+ * mcs_lock是队列锁：每个申请者在自己的节点上自旋，释放时只把锁交给下一个节点，
+ * 争用激烈时不会所有CPU都盯着同一个缓存行
+ * **************************/
+struct spinlock{
+  volatile uint32_t slock;      //低16位是当前叫到的号，高16位是下一个要发出的号
+};
+
+#define TICKET_SHIFT 16
+
+/* MCS锁的等待节点，由申请者自己提供，一般放在栈上，直到释放锁为止 */
+struct mcs_node{
+  struct mcs_node* volatile next;   //排在自己后面的节点
+  volatile uint32_t locked;         //1表示还在等待，前一个节点释放锁时将其清0
+};
+
+struct mcs_lock{
+  struct mcs_node* volatile tail;   //队尾节点，NULL表示锁空闲
+};
+
+/* 自旋等待时提示CPU，降低功耗并避免退出循环时的流水线惩罚 */
+static inline void cpu_relax(void){
+  asm volatile ("pause" : : : "memory");
+}
+
+/* 原子地把*ptr置为val，返回旧值，xchg访问内存时隐含lock前缀 */
+static inline uint32_t atomic_xchg(volatile uint32_t* ptr, uint32_t val){
+  asm volatile ("xchgl %0, %1" : "+r"(val), "+m"(*ptr) : : "memory");
+  return val;
+}
+
+/* 原子地把*ptr加上val，返回加之前的值 */
+static inline uint32_t atomic_xadd(volatile uint32_t* ptr, uint32_t val){
+  asm volatile ("lock xaddl %0, %1" : "+r"(val), "+m"(*ptr) : : "memory");
+  return val;
+}
+
+/* 若*ptr等于old就把它置为new，返回*ptr原来的值 */
+static inline uint32_t atomic_cmpxchg(volatile uint32_t* ptr, uint32_t old, uint32_t new){
+  uint32_t prev;
+  asm volatile ("lock cmpxchgl %2, %1" : "=a"(prev), "+m"(*ptr) : "r"(new), "0"(old) : "memory");
+  return prev;
+}
+
+void spin_lock_init(struct spinlock* lock);
+void spin_lock(struct spinlock* lock);
+bool spin_trylock(struct spinlock* lock);
+void spin_unlock(struct spinlock* lock);
+bool spin_is_locked(struct spinlock* lock);
+enum intr_status spin_lock_irqsave(struct spinlock* lock);
+void spin_unlock_irqrestore(struct spinlock* lock, enum intr_status old_status);
+void mcs_lock_init(struct mcs_lock* lock);
+void mcs_lock(struct mcs_lock* lock, struct mcs_node* node);
+void mcs_unlock(struct mcs_lock* lock, struct mcs_node* node);
+enum intr_status mcs_lock_irqsave(struct mcs_lock* lock, struct mcs_node* node);
+void mcs_unlock_irqrestore(struct mcs_lock* lock, struct mcs_node* node, enum intr_status old_status);
+#endif
@@ -3,77 +3,332 @@
 #include "debug.h"
 #include "global.h"
 #include "interrupt.h"
+#include "sched.h"
+
+/* 保护所有锁的等待队列、持有者交接和线程的blocked_on，
+ * 优先级继承沿等待链跨越多把锁，用一把全局锁串起来，只在锁有争用时才会用到。
+ * 加锁顺序：pi_lock -> lock.guard -> 运行队列的锁 */
+static struct spinlock pi_lock;
+
+/* 初始化同步机制的全局状态，须在第一次使用struct lock之前调用 */
+void sync_init(void){
+  spin_lock_init(&pi_lock);
+}
 
 /* 初始化信号量 */
-void sema_init(struct semaphore* psema, uint8_t value){
+void sema_init(struct semaphore* psema, uint32_t value){
   psema->value = value;     //信号量赋予初值
   list_init(&psema->waiters);   //初始化信号量的等待队列
+  spin_lock_init(&psema->lock);
 }
 
 /* 初始化锁plock */
 void lock_init(struct lock* plock){
   plock->holder = NULL;
   plock->holder_repeat_nr = 0;
-  sema_init(&plock->semaphore, 1);
+  list_init(&plock->waiters);
+  spin_lock_init(&plock->guard);
 }
 
 /* 信号量down操作 */
 void sema_down(struct semaphore* psema){
-  /* 关中断来保证原子操作 */
-  enum intr_status old_status = intr_disable();
+  /* 关中断并持有自旋锁来保证原子操作 */
+  enum intr_status old_status = spin_lock_irqsave(&psema->lock);
   while(psema->value == 0){         //使用while是因为被唤醒后仍需要继续竞争条件，而不是直接向下执行
-    ASSERT(!elem_find(&psema->waiters, &running_thread()->general_tag));    //当前线程不应该已在等待队列当中
-    if(elem_find(&psema->waiters, &running_thread()->general_tag)){
-      PANIC("sema_down: thread blocked has been in waiters_list\n");
-    }
+    ASSERT(!elem_on_list(&psema->waiters, &running_thread()->general_tag));    //当前线程不应该已在等待队列当中
     /* 若信号量的值等于0,则将自己加入该锁的等待队列中，然后阻塞自己 */
     list_append(&psema->waiters, &running_thread()->general_tag);
-    thread_block(TASK_BLOCKED);     //阻塞自己，直到被唤醒,这里会调度别的线程，所以不必担心关中断
+    thread_block_unlock(TASK_BLOCKED, &psema->lock);     //阻塞自己并释放自旋锁，直到被唤醒
+    spin_lock(&psema->lock);
   }
-  /* 若value为1或被唤醒之后，会执行下面代码，也就是获得了锁 */
+  /* 若value大于0或被唤醒之后，会执行下面代码，也就是获得了一个资源 */
   psema->value--;
-  ASSERT(psema->value == 0);
-  /* 恢复之前的中断状态 */
-  intr_set_status(old_status);
+  /* 释放自旋锁并恢复之前的中断状态 */
+  spin_unlock_irqrestore(&psema->lock, old_status);
+}
+
+/* 信号量的值大于0时减1并返回true，否则不阻塞，直接返回false */
+bool sema_trydown(struct semaphore* psema){
+  enum intr_status old_status = spin_lock_irqsave(&psema->lock);
+  bool ok = psema->value > 0;
+  if(ok){
+    psema->value--;
+  }
+  spin_unlock_irqrestore(&psema->lock, old_status);
+  return ok;
 }
 
 /* 信号量的up操作 */
 void sema_up(struct semaphore* psema){
-  /* 关中断来保证原子操作 */
-  enum intr_status old_status = intr_disable();
-  ASSERT(psema->value == 0);
+  /* 关中断并持有自旋锁来保证原子操作 */
+  struct task_struct* thread_blocked = NULL;
+  enum intr_status old_status = spin_lock_irqsave(&psema->lock);
   if(!list_empty(&psema->waiters)){
-    struct task_struct* thread_blocked = elem2entry(struct task_struct, general_tag, list_pop(&psema->waiters));
-    thread_unblock(thread_blocked);
+    thread_blocked = elem2entry(struct task_struct, general_tag, list_pop(&psema->waiters));
   }
   psema->value++;
-  ASSERT(psema->value == 1);
+  spin_unlock(&psema->lock);
+  /* 被唤醒的线程已从等待队列摘下，可以在锁外唤醒 */
+  if(thread_blocked != NULL){
+    thread_unblock(thread_blocked);
+  }
   /* 恢复之前的状态 */
   intr_set_status(old_status);
 }
 
-/* 获取锁plock */
+/* plock的等待者中最高的优先级，没有等待者时为0，须持有pi_lock */
+static uint8_t waiters_max_prio(struct lock* plock){
+  uint8_t prio = 0;
+  struct list_elem* elem = plock->waiters.head.next;
+  while(elem != &plock->waiters.tail){
+    struct task_struct* waiter = elem2entry(struct task_struct, general_tag, elem);
+    if(waiter->priority > prio){
+      prio = waiter->priority;
+    }
+    elem = elem->next;
+  }
+  return prio;
+}
+
+/* 把prio沿着从plock开始的等待链传下去：持有者优先级低于prio就提高到prio，
+ * 持有者自己也在等锁时再传给那把锁的持有者，须持有pi_lock。
+ * 链上的锁都有等待者，其holder只会在持有pi_lock时改变。
+ * 链长有上限，出现死锁成环时也能停下来 */
+static void pi_propagate(struct lock* plock, uint8_t prio){
+  uint32_t depth = 0;
+  while(plock != NULL && depth++ < PI_CHAIN_MAX){
+    struct task_struct* holder = plock->holder;
+    if(holder == NULL || holder->priority >= prio){
+      break;
+    }
+    sched_set_prio(holder, prio);
+    plock = holder->blocked_on;
+  }
+}
+
+/* 获取锁plock，锁被占用时排队并阻塞，同时把自己的优先级借给持有者，
+ * 释放者直接把锁交给等待者中优先级最高的线程，被唤醒时锁已经归自己所有 */
 void lock_acquire(struct lock* plock){
+  struct task_struct* cur = running_thread();
   /* 排除曾经自己已经持有锁但还未将其释放的状态 */
-  if(plock->holder != running_thread()){
-    sema_down(&plock->semaphore);   //对信号量P操作
-    plock->holder = running_thread();
-    ASSERT(plock->holder_repeat_nr == 0);
-    plock->holder_repeat_nr = 1;
-  }else{
+  if(plock->holder == cur){
     plock->holder_repeat_nr++;
+    return;
+  }
+  enum intr_status old_status = spin_lock_irqsave(&plock->guard);
+  if(plock->holder == NULL){
+    plock->holder = cur;
+    spin_unlock(&plock->guard);
+  }else{
+    /* 有争用，按加锁顺序先拿pi_lock再重新检查 */
+    spin_unlock(&plock->guard);
+    spin_lock(&pi_lock);
+    spin_lock(&plock->guard);
+    if(plock->holder == NULL){
+      plock->holder = cur;
+      spin_unlock(&plock->guard);
+      spin_unlock(&pi_lock);
+    }else{
+      ASSERT(!elem_on_list(&plock->waiters, &cur->general_tag));
+      list_append(&plock->waiters, &cur->general_tag);
+      cur->blocked_on = plock;
+      pi_propagate(plock, cur->priority);
+      spin_unlock(&pi_lock);
+      thread_block_unlock(TASK_BLOCKED, &plock->guard);
+      ASSERT(plock->holder == cur && cur->blocked_on == NULL);
+      /* 释放者已把锁记入cur->held_locks */
+      intr_set_status(old_status);
+      ASSERT(plock->holder_repeat_nr == 0);
+      plock->holder_repeat_nr = 1;
+      return;
+    }
   }
+  /* 只有持有者自己会往held_locks中添加，交接时持有者正在阻塞，不会同时修改 */
+  list_append(&cur->held_locks, &plock->holder_tag);
+  intr_set_status(old_status);
+  ASSERT(plock->holder_repeat_nr == 0);
+  plock->holder_repeat_nr = 1;
 }
 
-/* 释放锁plock */
+/* 释放锁plock，有等待者时把锁交给其中优先级最高的线程并唤醒它，
+ * 然后按仍持有的锁上的等待者重新计算自己的优先级，撤销因plock继承来的部分 */
 void lock_release(struct lock* plock){
-  ASSERT(plock->holder == running_thread());
+  struct task_struct* cur = running_thread();
+  ASSERT(plock->holder == cur);
   if(plock->holder_repeat_nr > 1){
     plock->holder_repeat_nr--;
     return ;
   }
   ASSERT(plock->holder_repeat_nr == 1);
-  plock->holder = NULL;     //把锁的持有者置空放在V操作之前
   plock->holder_repeat_nr = 0;
-  sema_up(&plock->semaphore);   //对信号量V操作
-}
\ No newline at end of file
+  struct task_struct* next = NULL;
+  enum intr_status old_status = intr_disable();
+  spin_lock(&pi_lock);
+  spin_lock(&plock->guard);
+  list_remove(&plock->holder_tag);
+  struct list_elem* elem = plock->waiters.head.next;
+  while(elem != &plock->waiters.tail){
+    struct task_struct* waiter = elem2entry(struct task_struct, general_tag, elem);
+    /* 优先级相同时取先来的 */
+    if(next == NULL || waiter->priority > next->priority){
+      next = waiter;
+    }
+    elem = elem->next;
+  }
+  if(next != NULL){
+    list_remove(&next->general_tag);
+    next->blocked_on = NULL;
+    list_append(&next->held_locks, &plock->holder_tag);
+  }
+  plock->holder = next;
+  spin_unlock(&plock->guard);
+
+  /* next是剩下的等待者中优先级最高的，无需再为它继承，只需重新计算自己的 */
+  uint8_t prio = cur->base_priority;
+  elem = cur->held_locks.head.next;
+  while(elem != &cur->held_locks.tail){
+    uint8_t waiter_prio = waiters_max_prio(elem2entry(struct lock, holder_tag, elem));
+    if(waiter_prio > prio){
+      prio = waiter_prio;
+    }
+    elem = elem->next;
+  }
+  if(prio != cur->priority){
+    sched_set_prio(cur, prio);
+  }
+  spin_unlock(&pi_lock);
+  /* 在锁外唤醒，thread_unblock会等next切换出去后才把它放入就绪队列 */
+  if(next != NULL){
+    thread_unblock(next);
+  }
+  intr_set_status(old_status);
+}
+
+/* 唤醒list中的所有线程，list已不在任何锁的保护之下 */
+static void wake_all(struct list* list){
+  while(!list_empty(list)){
+    thread_unblock(elem2entry(struct task_struct, general_tag, list_pop(list)));
+  }
+}
+
+/* 初始化条件变量 */
+void cond_init(struct condition* cond){
+  list_init(&cond->waiters);
+  spin_lock_init(&cond->lock);
+}
+
+/* 释放plock并等待cond被通知，返回前重新获得plock。
+ * 先挂到等待队列再释放plock，通知者须持有plock才能改变条件，所以不会丢失通知。
+ * 被唤醒时条件未必仍然成立，调用者应在循环中检查 */
+void cond_wait(struct condition* cond, struct lock* plock){
+  struct task_struct* cur = running_thread();
+  ASSERT(plock->holder == cur && plock->holder_repeat_nr == 1);
+  enum intr_status old_status = spin_lock_irqsave(&cond->lock);
+  list_append(&cond->waiters, &cur->general_tag);
+  lock_release(plock);
+  thread_block_unlock(TASK_BLOCKED, &cond->lock);
+  intr_set_status(old_status);
+  lock_acquire(plock);
+}
+
+/* 唤醒一个等待cond的线程 */
+void cond_signal(struct condition* cond){
+  struct task_struct* waiter = NULL;
+  enum intr_status old_status = spin_lock_irqsave(&cond->lock);
+  if(!list_empty(&cond->waiters)){
+    waiter = elem2entry(struct task_struct, general_tag, list_pop(&cond->waiters));
+  }
+  spin_unlock(&cond->lock);
+  if(waiter != NULL){
+    thread_unblock(waiter);
+  }
+  intr_set_status(old_status);
+}
+
+/* 唤醒所有等待cond的线程 */
+void cond_broadcast(struct condition* cond){
+  struct list woken;
+  list_init(&woken);
+  enum intr_status old_status = spin_lock_irqsave(&cond->lock);
+  while(!list_empty(&cond->waiters)){
+    list_append(&woken, list_pop(&cond->waiters));
+  }
+  spin_unlock(&cond->lock);
+  wake_all(&woken);
+  intr_set_status(old_status);
+}
+
+/* 初始化读写锁 */
+void rwlock_init(struct rwlock* rw){
+  spin_lock_init(&rw->guard);
+  rw->readers = 0;
+  rw->writer = NULL;
+  rw->waiting_writers = 0;
+  list_init(&rw->read_waiters);
+  list_init(&rw->write_waiters);
+}
+
+/* 在rw的某个等待队列上阻塞，须持有rw->guard，返回时仍持有 */
+static void rwlock_wait(struct rwlock* rw, struct list* waiters){
+  list_append(waiters, &running_thread()->general_tag);
+  thread_block_unlock(TASK_BLOCKED, &rw->guard);
+  spin_lock(&rw->guard);
+}
+
+/* 获取读锁，没有写者持有且没有写者在等待时，可与其他读者同时持有 */
+void read_lock(struct rwlock* rw){
+  enum intr_status old_status = spin_lock_irqsave(&rw->guard);
+  while(rw->writer != NULL || rw->waiting_writers != 0){
+    rwlock_wait(rw, &rw->read_waiters);
+  }
+  rw->readers++;
+  spin_unlock_irqrestore(&rw->guard, old_status);
+}
+
+/* 释放读锁，最后一个读者离开时唤醒一个写者 */
+void read_unlock(struct rwlock* rw){
+  struct task_struct* writer = NULL;
+  enum intr_status old_status = spin_lock_irqsave(&rw->guard);
+  ASSERT(rw->readers > 0);
+  if(--rw->readers == 0 && !list_empty(&rw->write_waiters)){
+    writer = elem2entry(struct task_struct, general_tag, list_pop(&rw->write_waiters));
+  }
+  spin_unlock(&rw->guard);
+  if(writer != NULL){
+    thread_unblock(writer);
+  }
+  intr_set_status(old_status);
+}
+
+/* 获取写锁，与所有读者和其他写者互斥 */
+void write_lock(struct rwlock* rw){
+  struct task_struct* cur = running_thread();
+  enum intr_status old_status = spin_lock_irqsave(&rw->guard);
+  ASSERT(rw->writer != cur);
+  rw->waiting_writers++;
+  while(rw->writer != NULL || rw->readers != 0){
+    rwlock_wait(rw, &rw->write_waiters);
+  }
+  rw->waiting_writers--;
+  rw->writer = cur;
+  spin_unlock_irqrestore(&rw->guard, old_status);
+}
+
+/* 释放写锁，优先唤醒下一个写者，没有写者等待时唤醒所有读者 */
+void write_unlock(struct rwlock* rw){
+  struct list woken;
+  list_init(&woken);
+  enum intr_status old_status = spin_lock_irqsave(&rw->guard);
+  ASSERT(rw->writer == running_thread());
+  rw->writer = NULL;
+  if(!list_empty(&rw->write_waiters)){
+    list_append(&woken, list_pop(&rw->write_waiters));
+  }else{
+    while(!list_empty(&rw->read_waiters)){
+      list_append(&woken, list_pop(&rw->read_waiters));
+    }
+  }
+  spin_unlock(&rw->guard);
+  wake_all(&woken);
+  intr_set_status(old_status);
+}
@@ -4,24 +4,58 @@
 #include "list.h"
 #include "stdint.h"
 #include "thread.h"
+#include "spinlock.h"
 
-/* 信号量结构 */
+/* 信号量结构，计数型 */
 struct semaphore{
-  uint8_t value;                //记录信号量的值
+  uint32_t value;               //记录信号量的值，即可用资源数
   struct list waiters;          //记录等待的所有线程
+  struct spinlock lock;         //多个CPU间保护value和waiters
 };
 
-/* 锁结构 */
+/* 锁结构，可睡眠，持有期间可以阻塞 */
 struct lock{
   struct task_struct* holder;   //锁的持有者
-  struct semaphore semaphore;   //用二元信号量来实现锁
+  struct list waiters;          //等待此锁的线程
+  struct spinlock guard;        //保护holder和waiters，只在检查和排队的瞬间持有
   uint32_t holder_repeat_nr;    //锁的持有者重复申请锁的次数
+  struct list_elem holder_tag;  //在持有者held_locks中的节点
 };
 
-void sema_init(struct semaphore* psema,uint8_t value);
+/* 优先级继承沿等待链最多传递的层数 */
+#define PI_CHAIN_MAX 8
+
+/* 条件变量，须与一把struct lock配合使用 */
+struct condition{
+  struct list waiters;          //等待条件成立的线程
+  struct spinlock lock;         //保护waiters
+};
+
+/* 读写锁，可睡眠，写者优先：有写者在等待时新来的读者也要等待，避免写者饿死 */
+struct rwlock{
+  struct spinlock guard;        //保护以下各项
+  uint32_t readers;             //持有读锁的线程数
+  struct task_struct* writer;   //持有写锁的线程
+  uint32_t waiting_writers;     //等待写锁的线程数
+  struct list read_waiters;
+  struct list write_waiters;
+};
+
+void sync_init(void);
+void sema_init(struct semaphore* psema, uint32_t value);
 void lock_init(struct lock* plock);
 void sema_down(struct semaphore* psema);
+bool sema_trydown(struct semaphore* psema);
 void sema_up(struct semaphore* psema);
 void lock_acquire(struct lock* plock);
 void lock_release(struct lock* plock);
+void cond_init(struct condition* cond);
+void cond_wait(struct condition* cond, struct lock* plock);
+void cond_signal(struct condition* cond);
+void cond_broadcast(struct condition* cond);
+void rwlock_init(struct rwlock* rw);
+void read_lock(struct rwlock* rw);
+void read_unlock(struct rwlock* rw);
+void write_lock(struct rwlock* rw);
+void write_unlock(struct rwlock* rw);
 #endif
\ No newline at end of file
@@ -9,36 +9,61 @@
 #include "print.h"
 #include "process.h"
 #include "sync.h"
+#include "sched.h"
+#include "timer.h"
+#include "spinlock.h"
+#include "smp.h"
+#include "fpu.h"
+#include "irqtrace.h"
+#include "softirq.h"
+#include "workqueue.h"
+#include "pid.h"
+#include "rcu.h"
 
 extern void *intr_exit;
 
 struct task_struct* main_thread;    //主线程PCB
-struct list thread_ready_list;      //就绪队列
 struct list thread_all_list;        //所有任务队列
-static struct list_elem* thread_tag;    //用于保存队列中的线程结点
-struct lock pid_lock;               //分配pid锁
-struct task_struct* idle_thread;
+static struct spinlock all_list_lock;   //写者之间互斥，读者用RCU遍历thread_all_list
+static struct spinlock exit_lock;   //保护各线程的exit_status、detached和joiner
+
+/* 回收的PCB页，下次创建线程时直接复用，不必再分配页框、改页表和清零整页 */
+static struct task_struct* pcb_cache[PCB_CACHE_MAX];
+static uint32_t pcb_cache_cnt;
+static struct spinlock pcb_cache_lock;
 
 extern void switch_to(struct task_struct* cur, struct task_struct* next);
 
-/* 系统空闲的时候运行的闲逛线程 */
+/* 系统空闲的时候运行的闲逛线程，每个CPU一个 */
 static void idle(void* arg UNUSED){
   while(1){
     thread_block(TASK_BLOCKED);
-    /* 执行hlt时必须要保证目前处在开中断的情况下 */
+    /* 关中断后再检查一次，避免在两者之间到来的唤醒IPI被错过，
+     * 先处理因重新处理轮数用完而留下的软中断，它们可能唤醒线程 */
+    intr_disable();
+    do_softirq();
+    if(!sched_ready_empty(cpu_id())){
+      intr_enable();
+      continue;
+    }
+    /* 根据下一个定时器的到期时间把时钟改为单次触发，避免空闲时每个tick都被唤醒 */
+    tick_nohz_idle_enter();
+    /* 空闲也是静止状态，之后开始的宽限期会发IPI把本CPU唤醒 */
+    rcu_note_context_switch(cpu_id());
+    IRQTRACE_ON(cpu_idle);
+    /* 执行hlt时必须要保证目前处在开中断的情况下，
+     * sti的下一条指令执行后才会响应中断，所以不会错过唤醒 */
     asm volatile ("sti; hlt" : : : "memory");
+    /* 被其他中断提前唤醒时补记经过的时间 */
+    tick_nohz_idle_exit();
   }
 }
 
-
-/* 分配pid */
-static pid_t allocate_pid(void){
-  static pid_t next_pid = 0;        //静态局部变量，相似于全局变量，所以这里函数结束后并不会消失
-  lock_acquire(&pid_lock);
-  next_pid++;
-  lock_release(&pid_lock);
-  return next_pid;
+/* AP启动完毕后在自己的idle线程中调用，不再返回 */
+void cpu_idle(void){
+  idle(NULL);
 }
+
 /* 获取当前线程PCB指针 */
 struct task_struct* running_thread(){
   uint32_t esp;
@@ -53,6 +78,8 @@ static void kernel_thread(thread_func* function, void* func_arg){
   /* 执行function前要开中断，避免后面的时钟中断被屏蔽，而无法调度其他程序 */
   intr_enable();
   function(func_arg);
+  /* function返回即线程结束 */
+  thread_exit(0);
 }
 
 /* 初始化线程栈thread_stack, 将待执行的函数和参数放到thread_stack中的相应位置*/
@@ -70,10 +97,14 @@ void thread_create(struct task_struct* pthread, thread_func function, void* func
   kthread_stack->ebp = kthread_stack->ebx = kthread_stack->esi = kthread_stack->edi = 0;
 }
 
+static void reap_work_func(void* arg);
+
 /* 初始化线程基本信息 */
 void init_thread(struct task_struct* pthread, char* name, int prio){
   memset(pthread, 0, sizeof(*pthread));
-  pthread->pid = allocate_pid();
+  pthread->blocked_on = NULL;
+  list_init(&pthread->held_locks);
+  pid_alloc(pthread);           //pid用完时为-1，由创建者检查
   strcpy(pthread->name, name);
   if(pthread == main_thread){
     /* 由于把main函数也封装成一个线程，并且他是一直运行的，故将其直接设为TASK_RUNNING*/
@@ -85,41 +116,216 @@ void init_thread(struct task_struct* pthread, char* name, int prio){
   /* self_kstack是线程自己在内核态下使用的栈顶地址 */
   pthread->self_kstack = (uint32_t*)((uint32_t)pthread + PG_SIZE);
 
-  pthread->priority = prio;
-  pthread->ticks = prio;
+  pthread->on_cpu = (pthread == main_thread);
+  pthread->cpu = 0;
+  pthread->priority = pthread->base_priority = prio;
+  sched_task_init(pthread);     //根据优先级确定起始级别和时间片
+  fpu_task_init(pthread);
   pthread->elapsed_ticks = 0;
-  pthread->pgdir = NULL;
+  pthread->stat.since = ticks;  //新线程从放入就绪队列起开始计等待时间
+  pthread->detached = false;
+  pthread->joiner = NULL;
+  work_init(&pthread->reap_work, reap_work_func, pthread);
+  pthread->mm = NULL;
+  pthread->tls_base = 0;
+  pthread->ustack = NULL;
   pthread->stack_magic = 0xdeadbeef;    //自定义魔数
-    /* 预留标准输入输出 */
-  pthread->fd_table[0] = 0;
-  pthread->fd_table[1] = 1;
-  pthread->fd_table[2] = 2;
-  /* 其余全置-1 */
-  uint8_t fd_idx = 3;
-  while(fd_idx < MAX_FILES_OPEN_PER_PROC){
-    pthread->fd_table[fd_idx] = -1;
-    fd_idx++;
+}
+
+/* 分配一页作为PCB和内核栈，优先复用回收的PCB页。
+ * 复用的页不清零，init_thread会初始化task_struct，栈上的内容用前都会写入 */
+struct task_struct* pcb_alloc(void){
+  struct task_struct* pthread = NULL;
+  enum intr_status old_status = spin_lock_irqsave(&pcb_cache_lock);
+  if(pcb_cache_cnt > 0){
+    pthread = pcb_cache[--pcb_cache_cnt];
+  }
+  spin_unlock_irqrestore(&pcb_cache_lock, old_status);
+  if(pthread == NULL){
+    /* PCB都位于内核空间，包括用户进程的PCB也在内核空间 */
+    pthread = get_kernel_pages(1);
   }
+  return pthread;
 }
 
-/* 创建一优先级为prio的线程，线程名为name，线程所执行的函数是function(func_arg) */
+/* 释放PCB页，缓存已满时才还给内核内存池 */
+void pcb_free(struct task_struct* pthread){
+  enum intr_status old_status = spin_lock_irqsave(&pcb_cache_lock);
+  if(pcb_cache_cnt < PCB_CACHE_MAX){
+    pcb_cache[pcb_cache_cnt++] = pthread;
+    pthread = NULL;
+  }
+  spin_unlock_irqrestore(&pcb_cache_lock, old_status);
+  if(pthread != NULL){
+    free_kernel_pages(pthread, 1);
+  }
+}
+
+/* 创建一优先级为prio的线程，线程名为name，线程所执行的函数是function(func_arg)。
+ * 线程默认可被thread_join回收，不关心其结束的可以thread_detach */
 struct task_struct* thread_start(char* name, int prio, thread_func function, void* func_arg){
-  /* PCB都位于内核空间，包括用户进程的PCB也在内核空间 */
-  struct task_struct* thread = get_kernel_pages(1);
+  return thread_start_policy(name, prio, SCHED_FAIR, function, func_arg);
+}
+
+/* 同thread_start，新线程属于调度类policy(enum sched_policy)，
+ * 频繁等待I/O、要求响应快的内核线程用SCHED_MLFQ */
+struct task_struct* thread_start_policy(char* name, int prio, uint8_t policy, thread_func function, void* func_arg){
+  struct task_struct* thread = pcb_alloc();
+  if(thread == NULL){
+    return NULL;
+  }
   init_thread(thread, name, prio);
+  if(thread->pid < 0){
+    pcb_free(thread);
+    return NULL;
+  }
   thread_create(thread, function, func_arg);
+  sched_task_setpolicy(thread, policy);
 
-  
-  /* 确保之前不在队列中 */
-  ASSERT(!elem_find(&thread_ready_list, &thread->general_tag));
-  /* 加入就绪线程队列 */
-  list_append(&thread_ready_list, &thread->general_tag);
+  thread_enqueue_new(thread);
+  return thread;
+}
 
+/* 把pthread加入全部线程队列 */
+void thread_all_list_add(struct task_struct* pthread){
+  enum intr_status old_status = spin_lock_irqsave(&all_list_lock);
   /* 确保之前不在队列中 */
-  ASSERT(!elem_find(&thread_all_list, &thread->all_list_tag));
-  /* 加入全部线程队列 */
-  list_append(&thread_all_list, &thread->all_list_tag);
-  return thread;
+  ASSERT(!elem_on_list(&thread_all_list, &pthread->all_list_tag));
+  list_append_rcu(&thread_all_list, &pthread->all_list_tag);
+  spin_unlock_irqrestore(&all_list_lock, old_status);
+}
+
+/* 把新创建的线程或进程放入负载最轻的CPU的就绪队列，并加入全部线程队列 */
+void thread_enqueue_new(struct task_struct* pthread){
+  thread_all_list_add(pthread);
+  enum intr_status old_status = intr_disable();
+  pthread->cpu = sched_select_cpu();
+  sched_enqueue(pthread);
+  smp_resched(pthread->cpu);
+  intr_set_status(old_status);
+}
+
+/* RCU回调，遍历thread_all_list的读者都已离开后释放PCB页 */
+static void pcb_free_rcu(void* arg){
+  pcb_free(arg);
+}
+
+/* 回收已退出的线程：等它在原CPU上切换出去，不再使用自己的栈，
+ * 再把它移出全部线程队列，过一个宽限期后释放PCB页 */
+static void thread_reap(struct task_struct* pthread){
+  ASSERT(pthread->status == TASK_DIED);
+  while(pthread->on_cpu){
+    cpu_relax();
+  }
+  enum intr_status old_status = spin_lock_irqsave(&all_list_lock);
+  list_remove_rcu(&pthread->all_list_tag);
+  spin_unlock_irqrestore(&all_list_lock, old_status);
+  pid_free(pthread);
+  call_rcu(&pthread->rcu, pcb_free_rcu, pthread);
+}
+
+/* 分离的线程的回收工作，reap_work就在要释放的PCB中，工作线程执行后不会再访问它 */
+static void reap_work_func(void* arg){
+  thread_reap(arg);
+}
+
+/* 结束当前内核线程，status交给thread_join的调用者，不再返回。
+ * 退出时不能持有锁，用户线程须先用mm_exit离开并释放地址空间 */
+void thread_exit(int32_t status){
+  struct task_struct* cur = running_thread();
+  ASSERT(cur->mm == NULL);
+  ASSERT(cur != main_thread && cur != this_cpu()->idle);
+  ASSERT(list_empty(&cur->held_locks));
+  intr_disable();
+  spin_lock(&exit_lock);
+  cur->exit_status = status;
+  cur->status = TASK_DIED;
+  bool detached = cur->detached;
+  struct task_struct* joiner = cur->joiner;
+  spin_unlock(&exit_lock);
+  /* PCB要等本线程切换出去后才能释放，回收者会等待on_cpu清0 */
+  if(detached){
+    queue_work(&cur->reap_work);
+  }else if(joiner != NULL){
+    thread_unblock(joiner);
+  }
+  schedule();
+  PANIC("thread_exit: dead thread scheduled");
+}
+
+/* 等待pthread结束并回收它，返回其退出状态。
+ * 每个线程只能被一个线程join一次，分离的线程不能join */
+int32_t thread_join(struct task_struct* pthread){
+  struct task_struct* cur = running_thread();
+  ASSERT(pthread != cur);
+  enum intr_status old_status = spin_lock_irqsave(&exit_lock);
+  ASSERT(!pthread->detached && pthread->joiner == NULL);
+  if(pthread->status != TASK_DIED){
+    pthread->joiner = cur;
+    thread_block_unlock(TASK_BLOCKED, &exit_lock);
+  }else{
+    spin_unlock(&exit_lock);
+  }
+  intr_set_status(old_status);
+  ASSERT(pthread->status == TASK_DIED);
+  int32_t status = pthread->exit_status;
+  thread_reap(pthread);
+  return status;
+}
+
+/* 分离pthread，它结束后自动回收，若已经结束则现在就回收 */
+void thread_detach(struct task_struct* pthread){
+  enum intr_status old_status = spin_lock_irqsave(&exit_lock);
+  ASSERT(!pthread->detached && pthread->joiner == NULL);
+  pthread->detached = true;
+  bool died = (pthread->status == TASK_DIED);
+  spin_unlock_irqrestore(&exit_lock, old_status);
+  if(died){
+    thread_reap(pthread);
+  }
+}
+
+/* 系统调用schedstat，把全部线程的调度统计拷贝到buf中，最多cnt项，返回拷贝的项数 */
+int32_t sys_schedstat(struct task_stat* buf, uint32_t cnt){
+  if(buf == NULL){
+    return -1;
+  }
+  uint32_t copied = 0;
+  /* 不加锁遍历，遍历期间退出的线程其PCB在读临界区结束前不会被释放 */
+  rcu_read_lock();
+  uint32_t now = ticks;
+  struct list_elem* elem = rcu_dereference(thread_all_list.head.next);
+  while(elem != &thread_all_list.tail && copied < cnt){
+    struct task_struct* pthread = elem2entry(struct task_struct, all_list_tag, elem);
+    struct task_stat* ts = &buf[copied++];
+    ts->pid = pthread->pid;
+    ts->status = pthread->status;
+    ts->cpu = pthread->cpu;
+    memcpy(ts->name, pthread->name, sizeof(ts->name));
+    ts->run_ticks = pthread->elapsed_ticks;
+    ts->wait_ticks = pthread->stat.wait_ticks;
+    ts->block_ticks = pthread->stat.block_ticks;
+    ts->nvcsw = pthread->stat.nvcsw;
+    ts->nivcsw = pthread->stat.nivcsw;
+    if(pthread->status == TASK_READY){
+      ts->wait_ticks += now - pthread->stat.since;
+    }else if(pthread->status != TASK_RUNNING && pthread->status != TASK_DIED){
+      ts->block_ticks += now - pthread->stat.since;
+    }
+    elem = rcu_dereference(elem->next);
+  }
+  rcu_read_unlock();
+  return copied;
+}
+
+/* 由intr_exit在中断返回前调用，本CPU被要求重新调度时让出CPU */
+void preempt_check_resched(void){
+  enum intr_status old_status = intr_disable();
+  /* RCU读临界区中不能调度，留到rcu_read_unlock时再调度 */
+  if(this_cpu()->need_resched && running_thread()->rcu_read_depth == 0){
+    schedule();
+  }
+  intr_set_status(old_status);
 }
 
 /* 将kernel中的main函数完善为主线程 */
@@ -131,39 +337,62 @@ static void make_main_thread(void){
   main_thread = running_thread();
   init_thread(main_thread, "main", 31);
 
-  /* main函数只是当前线程，当前线程不在thread_ready_list中，所以将其加入thread_all_list中*/
-  ASSERT(!elem_find(&thread_all_list, &main_thread->all_list_tag));
-  list_append(&thread_all_list, &main_thread->all_list_tag);
+  /* main函数只是当前线程，当前线程不在就绪队列中，所以将其加入thread_all_list中*/
+  thread_all_list_add(main_thread);
+  cpus[0].curr = main_thread;
 }
 
-/* 实现任务调度 */
+/* 实现任务调度，调用者需关中断，只在本CPU的队列中放入和取出线程 */
 void schedule(){
   ASSERT(intr_get_status() == INTR_OFF);
   struct task_struct* cur = running_thread();
+  struct cpu* cpu = &cpus[cur->cpu];
+  ASSERT(cur->rcu_read_depth == 0);
+  /* 调度说明本CPU已不在任何RCU读临界区中 */
+  rcu_note_context_switch(cpu->id);
+  bool preempted = (cur->status == TASK_RUNNING);
   if(cur->status == TASK_RUNNING){
-    //这里若是从运行态调度，则是其时间片到了的正常切换，因此将其改变为就绪态
-    ASSERT(!elem_find(&thread_ready_list, &cur->general_tag));
-    list_append(&thread_ready_list, &cur->general_tag);
-    cur->ticks = cur->priority;
-    //重新将当前线程的ticks再重置为其priority
+    //这里若是从运行态调度，说明当前线程被抢占，若是时间片用完则降一级并重新装填时间片
+    if(cur->ticks == 0){
+      sched_expire(cur);
+    }
     cur->status = TASK_READY;
+    /* idle线程不进入就绪队列，只在没有其他就绪线程时运行 */
+    if(cur != cpu->idle){
+      sched_enqueue(cur);
+    }
   }else{
     /* 说明可能是阻塞自己 */
   }
 
-  //ASSERT(!list_empty(&thread_ready_list));  /* 若队列为空会悬空 */
-  thread_tag = NULL;    //将thread_tag清空
-  /* 如果就绪队列当中没有可以运行的任务，就唤醒idle */
-  if(list_empty(&thread_ready_list)){
-    thread_unblock(idle_thread);
+  /* 从本CPU最高的非空级别中取出下一个线程，本地没有时从其他CPU窃取，都没有就运行idle */
+  struct task_struct* next = sched_pick_next(cpu->id);
+  if(next == NULL){
+    next = cpu->idle;
+  }
+  if(next != cur){
+    /* cur从此开始等待或阻塞，next结束等待，idle线程不在就绪队列中，不计等待时间 */
+    if(preempted){
+      cur->stat.nivcsw++;
+    }else{
+      cur->stat.nvcsw++;
+    }
+    cur->stat.since = ticks;
+    if(next != cpu->idle){
+      next->stat.wait_ticks += ticks - next->stat.since;
+    }
   }
-  /* 将thread_ready_list队列中的地一个就绪线程弹出，准备将他调入CPU运行*/
-  thread_tag = list_pop(&thread_ready_list);
-  struct task_struct* next = elem2entry(struct task_struct, general_tag, thread_tag);
+  cpu->need_resched = false;
   next->status = TASK_RUNNING;
+  next->cpu = cpu->id;
+  next->on_cpu = 1;
+  cpu->curr = next;
 
     /* 激活任务页表等 */
   process_activate(next);
+  if(next != cur){
+    fpu_switch_out(cur);
+  }
 
   switch_to(cur, next);
 }
@@ -178,13 +407,25 @@ void thread_block(enum task_status stat){
   intr_set_status(old_status);//恢复原中断状态
 }
 
+/* 在持有自旋锁lock时阻塞自己，调用者需关中断。
+ * 先设置好状态再释放lock，其他CPU上的唤醒者拿到lock后即可调用thread_unblock，
+ * thread_unblock会等到本线程切换出去后再把它放回就绪队列 */
+void thread_block_unlock(enum task_status stat, struct spinlock* lock){
+  ASSERT(((stat == TASK_BLOCKED) || (stat == TASK_WAITING) || (stat == TASK_HANGING)));
+  ASSERT(intr_get_status() == INTR_OFF);
+  running_thread()->status = stat;
+  spin_unlock(lock);
+  schedule();
+}
+
 /* 主动让出cpu，换其他线程运行 */
 void thread_yield(void){
   struct task_struct* cur_thread = running_thread();
   enum intr_status old_status = intr_disable();
-  ASSERT(!elem_find(&thread_ready_list, &cur_thread->general_tag));
-  list_append(&thread_ready_list, &cur_thread->general_tag);
   cur_thread->status = TASK_READY;
+  if(cur_thread != this_cpu()->idle){
+    sched_enqueue(cur_thread);
+  }
   schedule();
   intr_set_status(old_status);
 }
@@ -196,29 +437,64 @@ void thread_unblock(struct task_struct* pthread){
   (pthread->status == TASK_WAITING) || (pthread->status == TASK_HANGING)));
   enum intr_status old_status = intr_disable(); //关闭中断
   if(pthread->status != TASK_READY){
-    ASSERT(!elem_find(&thread_ready_list, &pthread->general_tag))
-    if(elem_find(&thread_ready_list, &pthread->general_tag)) //ASSERT在前，应该不会执行到这里
-    {
-      PANIC("thread_unblock: bolcked thread in ready_list\n");
+    /* 目标线程可能刚把自己置为阻塞态，还没在它的CPU上切换出去，等它离开CPU再放回就绪队列 */
+    while(pthread->on_cpu){
+      cpu_relax();
     }
-    list_push(&thread_ready_list, &pthread->general_tag); //放到队头，使快速执行
+    sched_wakeup(pthread);    //等待I/O而阻塞的线程在这里获得提升
+    pthread->stat.block_ticks += ticks - pthread->stat.since;
+    pthread->stat.since = ticks;
     pthread->status = TASK_READY; //设置该进程的状态为就绪状态
+    sched_enqueue(pthread);   //放回原来CPU的就绪队列
+    /* 被唤醒的线程更应该运行时，让其CPU在中断返回前就调度，而不是等当前线程的时间片用完 */
+    if(sched_wakeup_preempt(pthread)){
+      smp_preempt(pthread->cpu);
+    }
   }
   
 
   intr_set_status(old_status);//恢复原中断状态
 }
 
+/* 为cpu创建idle线程并记入cpus[cpu].idle。
+ * BSP的idle线程在首次被schedule选中时从idle函数开始执行，
+ * AP则直接以idle线程所在页作为启动栈，启动完毕后调用cpu_idle进入循环，
+ * AP的idle线程在其上线时才加入全部线程队列 */
+struct task_struct* idle_thread_create(uint8_t cpu){
+  struct task_struct* idle_thread = get_kernel_pages(1);
+  if(idle_thread == NULL){
+    return NULL;
+  }
+  char name[16] = "idle0";
+  name[4] += cpu;
+  init_thread(idle_thread, name, 10);
+  idle_thread->cpu = cpu;
+  if(cpu == 0){
+    thread_create(idle_thread, idle, NULL);
+    thread_all_list_add(idle_thread);
+  }else{
+    idle_thread->status = TASK_RUNNING;
+    idle_thread->on_cpu = 1;
+  }
+  cpus[cpu].idle = idle_thread;
+  return idle_thread;
+}
+
 /* 初始化线程环境 */
 void thread_init(void){
   put_str("thread_init start\n");
-  list_init(&thread_ready_list);
+  sched_init();
   list_init(&thread_all_list);
+  spin_lock_init(&all_list_lock);
+  spin_lock_init(&exit_lock);
+  spin_lock_init(&pcb_cache_lock);
+  pcb_cache_cnt = 0;
+  sync_init();
+  pid_init();
   /* 将当前main函数创建为线程 */
-  lock_init(&pid_lock);
   make_main_thread();
   
-  /* 创建idle线程 */
-  idle_thread = thread_start("idle", 10, idle, NULL);
+  /* 创建BSP的idle线程，它不进入就绪队列，只在没有其他就绪线程时由schedule选中 */
+  idle_thread_create(0);
   put_str("thread_init done\n");
 }
\ No newline at end of file
@@ -2,7 +2,11 @@
 #define __THREAD_H
 #include "stdint.h"
 #include "list.h"
+#include "rbtree.h"
 #include "memory.h"
+#include "fpu.h"
+#include "workqueue.h"
+#include "rcu.h"
 
 #define MAX_FILES_OPEN_PER_PROC 8  //每个进程最大打开文件数
 /* 自定义通用函数类型，它将在很多线程函数中作为形参类型 */
@@ -10,6 +14,8 @@ typedef void thread_func(void*);
 
 typedef int16_t pid_t;
 
+#define PCB_CACHE_MAX 8     //回收的PCB页最多缓存这么多，多出的还给内核内存池
+
 /* 进程或线程的状态 */
 enum task_status{
   TASK_RUNNING,
@@ -74,42 +80,119 @@ struct thread_stack{
   void* func_arg;               //kernel_thread所调用的函数所需要的参数
 };
 
+struct uring_ctx;
+struct vdso_proc;
+
+/* 进程的地址空间，由同一进程的所有线程共享，最后一个线程退出时释放 */
+struct mm_struct{
+  uint32_t* pgdir;              //进程自己页表的虚拟地址
+  struct virtual_addr userprog_vaddr;   //用户进程的虚拟地址
+  struct mem_block_desc u_block_desc[DESC_CNT];
+  int32_t fd_table[MAX_FILES_OPEN_PER_PROC];    //文件描述符数组
+  pid_t pid;                    //进程号，即创建此地址空间的线程的pid
+  volatile uint32_t users;      //共享此地址空间的线程数
+  struct uring_ctx* uring;      //提交/完成环，没有时为NULL
+  struct vdso_proc* vdso;       //映射给用户只读的进程常量页
+};
+
 /* 进程或线程的PCB */
+/* 调度统计，单位为tick，运行时间即elapsed_ticks */
+struct sched_stat{
+  uint32_t wait_ticks;          //在就绪队列中等待CPU的时间
+  uint32_t block_ticks;         //阻塞的时间，包括等待I/O和睡眠
+  uint32_t nvcsw;               //主动让出CPU（阻塞或yield）的次数
+  uint32_t nivcsw;              //时间片用完或被抢占而让出CPU的次数
+  uint32_t since;               //进入当前就绪或阻塞状态时的ticks
+};
+
+/* 线程统计快照中的一项，由sys_schedstat拷贝给用户 */
+struct task_stat{
+  pid_t pid;
+  uint8_t status;               //enum task_status
+  uint8_t cpu;
+  char name[16];
+  uint32_t run_ticks;
+  uint32_t wait_ticks;          //含当前仍在等待的部分
+  uint32_t block_ticks;         //含当前仍在阻塞的部分
+  uint32_t nvcsw;
+  uint32_t nivcsw;
+};
+
 struct task_struct{
   uint32_t* self_kstack;        //各内核线程都用自己的内核栈
+  /* 线程正在某个CPU上运行（或尚未从其栈上切换出去）时为1，
+   * switch_to在切换到下一个线程的栈之后才将其清0，偏移固定为4 */
+  volatile uint32_t on_cpu;
   pid_t pid;
   enum task_status status;
   char name[16];
-  uint8_t priority;             //线程优先级
-  uint8_t ticks;                //每次在处理器上执行的时间滴答数
+  uint8_t priority;             //线程当前的优先级，越大则在MLFQ中所能到达的级别越高，在公平调度中权重越大
+  uint8_t base_priority;        //线程自己的优先级，priority在继承了等待者的优先级时会高于它
+  uint8_t ticks;                //本次时间片中剩余的滴答数
+  uint8_t mlfq_level;           //当前所在的多级反馈队列级别，0最高
+  uint8_t cpu;                  //正在运行或所在就绪队列的CPU编号
+  uint8_t policy;               //调度类，enum sched_policy
+  uint32_t weight;              //公平调度的权重，由priority换算
+  uint32_t vruntime;            //公平调度中按权重折算的虚拟运行时间
+  struct rb_node fair_node;     //公平调度中在就绪红黑树中的节点
+  bool on_rq;                   //是否在某个CPU的就绪队列中
+
+  struct lock* blocked_on;      //正在等待的锁，优先级继承时沿此向下传递
+  struct list held_locks;       //持有的锁，释放时据此重新计算继承来的优先级
 
   /* 此任务自从上cpu运行后至今占用了多少cpu滴答数，
    * 也就是此任务执行了多久 */
   uint32_t elapsed_ticks;
+  struct sched_stat stat;       //等待、阻塞时间和切换次数
   
-  int32_t fd_table[MAX_FILES_OPEN_PER_PROC];    //文件描述符数组
   /* general_tag的作用是用于线程在一般的队列中的结点 */
   struct list_elem general_tag;
 
   /* all_list_tag的作用是用于线程队列thread_all_list中的节点 */
   struct list_elem all_list_tag;
+  struct list_elem pid_tag;     //在pid哈希表中的节点
 
-  uint32_t* pgdir;              //进程自己页表的虚拟地址
-  struct virtual_addr userprog_vaddr;   //用户进程的虚拟地址
-  struct mem_block_desc u_block_desc[DESC_CNT];
+  /* 退出与回收，由exit_lock保护 */
+  int32_t exit_status;          //thread_exit的参数，由thread_join取回
+  bool detached;                //退出后自动回收，不能再被thread_join
+  struct task_struct* joiner;   //在thread_join中等待本线程退出的线程
+  struct work_struct reap_work; //分离的线程退出后由工作线程回收其PCB
+  struct rcu_head rcu;          //移出thread_all_list后等宽限期结束再释放PCB
+  uint32_t rcu_read_depth;      //RCU读临界区的嵌套层数，不为0时不会被抢占
+
+  struct mm_struct* mm;         //所属进程的地址空间，内核线程为NULL
+  uint32_t tls_base;            //用户线程局部存储的基址，通过gs访问，0表示没有
+  void* ustack;                 //uthread_create分配的用户栈的保护页，进程主线程和内核线程为NULL
+  bool fpu_used;                //是否用过FPU，用过才有状态需要恢复
+  uint8_t fpu_cpu;              //最近一次把本线程的FPU状态装入寄存器的CPU
+  struct fpu_state fpu;         //切出时保存的FPU/SSE状态
   uint32_t stack_magic;         //栈的边界标记，用于检测栈的溢出
 };
 
-extern struct list thread_ready_list;
 extern struct list thread_all_list;
+struct spinlock;
+struct lock;
 
 struct task_struct* running_thread(void);
 void thread_create(struct task_struct* pthread, thread_func function, void* func_arg);
 void thread_block(enum task_status stat);
+void thread_block_unlock(enum task_status stat, struct spinlock* lock);
 void thread_unblock(struct task_struct* pthread);
 void thread_yield(void);
 void init_thread(struct task_struct* pthread, char* name, int prio);
 struct task_struct* thread_start(char* name, int prio, thread_func function, void* func_arg);
+struct task_struct* thread_start_policy(char* name, int prio, uint8_t policy, thread_func function, void* func_arg);
+struct task_struct* pcb_alloc(void);
+void pcb_free(struct task_struct* pthread);
+void thread_exit(int32_t status);
+int32_t thread_join(struct task_struct* pthread);
+void thread_detach(struct task_struct* pthread);
 void schedule(void);
+void preempt_check_resched(void);
+void thread_all_list_add(struct task_struct* pthread);
+void thread_enqueue_new(struct task_struct* pthread);
+struct task_struct* idle_thread_create(uint8_t cpu);
+void cpu_idle(void);
+int32_t sys_schedstat(struct task_stat* buf, uint32_t cnt);
 void thread_init(void);
 #endif
\ No newline at end of file
@@ -0,0 +1,60 @@
+#include "workqueue.h"
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+#include "thread.h"
+#include "sched.h"
+#include "sync.h"
+#include "spinlock.h"
+#include "interrupt.h"
+
+static struct list work_list;           //待执行的工作项
+static struct spinlock work_lock;       //保护work_list和各工作项的pending
+static struct semaphore work_sema;      //待执行的工作项数，工作线程在此等待
+
+/* 工作线程，逐个取出工作项执行 */
+static void worker(void* arg UNUSED){
+  while(1){
+    sema_down(&work_sema);
+    enum intr_status old_status = spin_lock_irqsave(&work_lock);
+    struct work_struct* work = elem2entry(struct work_struct, tag, list_pop(&work_list));
+    work->pending = false;
+    spin_unlock_irqrestore(&work_lock, old_status);
+    /* 清除pending之后再执行，执行期间提交的会再执行一次 */
+    work->func(work->arg);
+  }
+}
+
+/* 初始化工作队列并创建工作线程，须在thread_init之后调用 */
+void workqueue_init(void){
+  list_init(&work_list);
+  spin_lock_init(&work_lock);
+  sema_init(&work_sema, 0);
+  uint32_t idx;
+  for(idx = 0; idx < WORKQUEUE_WORKERS; idx++){
+    /* RCU回调、PCB回收等都在这里执行，用MLFQ使其被唤醒后能及时运行 */
+    thread_start_policy("kworker", WORKQUEUE_PRIO, SCHED_MLFQ, worker, NULL);
+  }
+}
+
+/* 初始化工作项，执行时调用func(arg) */
+void work_init(struct work_struct* work, work_func* func, void* arg){
+  work->func = func;
+  work->arg = arg;
+  work->pending = false;
+}
+
+/* 把work提交给工作线程执行，work已在队列中时返回false */
+bool queue_work(struct work_struct* work){
+  enum intr_status old_status = spin_lock_irqsave(&work_lock);
+  if(work->pending){
+    spin_unlock_irqrestore(&work_lock, old_status);
+    return false;
+  }
+  work->pending = true;
+  list_append(&work_list, &work->tag);
+  spin_unlock(&work_lock);
+  sema_up(&work_sema);
+  intr_set_status(old_status);
+  return true;
+}
@@ -0,0 +1,27 @@
+#ifndef __THREAD_WORKQUEUE_H
+#define __THREAD_WORKQUEUE_H
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+
+/********** 工作队列 **********
+ * 由专门的内核线程执行的工作项，与软中断不同，工作函数可以阻塞，
+ * 中断处理程序、软中断和普通线程都可以用queue_work提交。
+ * 同一工作项在执行前重复提交只执行一次，执行期间再次提交会在之后再执行一次
+ * ***************************/
+#define WORKQUEUE_WORKERS 2         //工作线程数
+#define WORKQUEUE_PRIO 31           //工作线程的优先级
+
+typedef void work_func(void* arg);
+
+struct work_struct{
+  struct list_elem tag;     //在工作队列中的节点
+  work_func* func;
+  void* arg;
+  bool pending;             //已提交尚未开始执行
+};
+
+void workqueue_init(void);
+void work_init(struct work_struct* work, work_func* func, void* arg);
+bool queue_work(struct work_struct* work);
+#endif
@@ -9,25 +9,56 @@
 #include "tss.h"
 #include "string.h"
 #include "list.h"
+#include "spinlock.h"
+#include "pid.h"
+#include "vdso-init.h"
+#include "uring-ctx.h"
+#include "syscall.h"
 
 extern void intr_exit(void);    //kernel.S中的中断返回函数
 
-/* 构建用户进程初始上下文信息,伪造中断返回的假象 */
-void start_process(void* filename){
-  void* function = filename;
-  struct task_struct* cur = running_thread();
-  cur->self_kstack += sizeof(struct thread_stack);      //使得其指向中断栈
-  struct intr_stack* proc_stack = (struct intr_stack*)cur->self_kstack;
+/* pthread内核栈顶的中断栈，用户线程从这里返回用户态 */
+static struct intr_stack* user_intr_stack(struct task_struct* pthread){
+  return (struct intr_stack*)((uint32_t)pthread + PG_SIZE - sizeof(struct intr_stack));
+}
+
+/* 在中断栈proc_stack中伪造从用户态进入中断的现场，返回后从function开始执行，用户栈顶为esp */
+static void user_intr_stack_init(struct intr_stack* proc_stack, void* function, void* esp){
   proc_stack->edi = proc_stack->esi = proc_stack->ebp = proc_stack->esp_dummy = 0;
   proc_stack->ebx = proc_stack->edx = proc_stack->ecx = proc_stack->eax = 0;
-  proc_stack->gs = 0;                                   //不允许用户进程直接访问显存段，所以置0
+  proc_stack->gs = 0;                                   //不允许用户进程直接访问显存段，所以置0，有TLS时由tls_activate设置
   proc_stack->ds = proc_stack->es = proc_stack->fs = SELECTOR_U_DATA;
   proc_stack->eip = function;
   proc_stack->cs = SELECTOR_U_CODE;
   proc_stack->eflags = (EFLAGS_IOPL_0 | EFLAGS_MBS | EFLAGS_IF_1);
-  proc_stack->esp = (void*)((uint32_t)get_a_page(PF_USER, USER_STACK3_VADDR) + PG_SIZE); //分配的是用户栈的最高地址处，也就是0xc0000000
+  proc_stack->esp = esp;
   proc_stack->ss = SELECTOR_U_DATA;
-  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g"(proc_stack) : "memory");
+}
+
+/* 从当前线程内核栈顶的中断栈返回用户态，不再返回。
+ * 关中断后再设置gs，免得设置之后被换到别的CPU上 */
+static void enter_user(void){
+  struct task_struct* cur = running_thread();
+  intr_disable();
+  tls_activate(cur);
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g"(user_intr_stack(cur)) : "memory");
+}
+
+/* 构建用户进程初始上下文信息,伪造中断返回的假象 */
+void start_process(void* filename){
+  void* function = filename;
+  vdso_map(running_thread()->mm);
+  uint32_t* esp = (uint32_t*)((uint32_t)get_a_page(PF_USER, USER_STACK3_VADDR) + PG_SIZE); //分配的是用户栈的最高地址处，也就是0xc0000000
+  /* 与用户线程一样留出参数和返回地址，function返回时结束线程 */
+  *--esp = 0;
+  *--esp = (uint32_t)uthread_return;
+  user_intr_stack_init(user_intr_stack(running_thread()), function, esp);
+  enter_user();
+}
+
+/* 用户线程的起点，中断栈已由sys_uthread_create构建好 */
+static void start_uthread(void* arg UNUSED){
+  enter_user();
 }
 
 /* 激活页表 */
@@ -39,8 +70,14 @@ void page_dir_activate(struct task_struct* p_thread){
    * ****************************************************/
   /* 若为内核线程，需要重新填充页表为0x100000 */
   uint32_t pagedir_phy_addr = 0x100000;      //默认为内核的页目录物理地址，也就是内核线程所用的页目录表
-  if(p_thread->pgdir != NULL){              //用户态进程有自己的页目录表
-    pagedir_phy_addr = addr_v2p((uint32_t)p_thread->pgdir);
+  if(p_thread->mm != NULL){                 //用户态进程有自己的页目录表
+    pagedir_phy_addr = addr_v2p((uint32_t)p_thread->mm->pgdir);
+  }
+  /* 同一进程的线程之间切换时页表不变，不重新加载cr3，免得刷掉TLB */
+  uint32_t cr3;
+  asm volatile ("movl %%cr3, %0" : "=r"(cr3));
+  if(cr3 == pagedir_phy_addr){
+    return;
   }
   /* 更新页目录寄存器cr3，使页表生效 */
   asm volatile ("movl %0, %%cr3" : : "r"(pagedir_phy_addr) : "memory");
@@ -52,9 +89,10 @@ void process_activate(struct task_struct* p_thread){
   /* 激活该进程或线程的页表 */
   page_dir_activate(p_thread);
   /* 内核线程特权级本身为0,处理器进入中断时并不会从tss中获取0特权级栈地址，因此不需要更新esp0 */
-  if(p_thread->pgdir){
+  if(p_thread->mm){
     /* 更新该进程的esp0, 用于此进程被中断时保护上下文 */
     update_tss_esp(p_thread);
+    tls_activate(p_thread);
   }
 }
 #include "print.h"
@@ -80,29 +118,200 @@ uint32_t* create_page_dir(void){
   return page_dir_vaddr;
 }
 
+#define USER_VADDR_BITMAP_BYTES ((0xc0000000 - USER_VADDR_START)/PG_SIZE/8)
+#define USER_VADDR_BITMAP_PAGES DIV_ROUND_UP(USER_VADDR_BITMAP_BYTES, PG_SIZE)    //位图所需要的最小页面数
+
 /* 创建用户进程虚拟地址位图 */
-void create_user_vaddr_bitmap(struct task_struct* user_prog){
-  user_prog->userprog_vaddr.vaddr_start = USER_VADDR_START;     //咱定义为0x804800
-  uint32_t bitmap_pg_cnt = DIV_ROUND_UP((0xc0000000 - USER_VADDR_START)/PG_SIZE/8, PG_SIZE);    //这里是计算得到位图所需要的最小页面数
-  user_prog->userprog_vaddr.vaddr_bitmap.bits = get_kernel_pages(bitmap_pg_cnt);         //用户位图同样存放在内核空间
-  user_prog->userprog_vaddr.vaddr_bitmap.btmp_bytes_len = (0xc0000000 - USER_VADDR_START)/PG_SIZE/8;
-  bitmap_init(&user_prog->userprog_vaddr.vaddr_bitmap);         //初始化用户位图
+void create_user_vaddr_bitmap(struct mm_struct* mm){
+  mm->userprog_vaddr.vaddr_start = USER_VADDR_START;     //咱定义为0x804800
+  mm->userprog_vaddr.vaddr_bitmap.bits = get_kernel_pages(USER_VADDR_BITMAP_PAGES);   //用户位图同样存放在内核空间
+  mm->userprog_vaddr.vaddr_bitmap.btmp_bytes_len = USER_VADDR_BITMAP_BYTES;
+  bitmap_init(&mm->userprog_vaddr.vaddr_bitmap);         //初始化用户位图
+}
+
+/* 为进程号为pid的新进程创建地址空间，此时只有创建它的线程一个使用者 */
+static struct mm_struct* mm_create(pid_t pid){
+  /* 和PCB一样由内核维护，在内核内存池中申请 */
+  struct mm_struct* mm = get_kernel_pages(1);
+  mm->pgdir = create_page_dir();                                //新建用户页目录并且返回页目录首地址
+  create_user_vaddr_bitmap(mm);                                 //构建位图
+  block_desc_init(mm->u_block_desc);
+  /* 预留标准输入输出，其余全置-1 */
+  mm->fd_table[0] = 0;
+  mm->fd_table[1] = 1;
+  mm->fd_table[2] = 2;
+  uint8_t fd_idx = 3;
+  while(fd_idx < MAX_FILES_OPEN_PER_PROC){
+    mm->fd_table[fd_idx] = -1;
+    fd_idx++;
+  }
+  mm->pid = pid;
+  mm->users = 1;
+  mm->uring = NULL;
+  mm->vdso = vdso_proc_create(pid);
+  return mm;
+}
+
+/* 新线程加入mm所属的进程，增加一个使用者 */
+static void mm_get(struct mm_struct* mm){
+  atomic_xadd(&mm->users, 1);
+}
+
+/* 让当前线程使用页表mm，mm为NULL时换回内核页表。
+ * 关中断免得在两步之间被调度，换入时按旧的mm装载页表 */
+static void mm_switch(struct mm_struct* mm){
+  struct task_struct* cur = running_thread();
+  enum intr_status old_status = intr_disable();
+  cur->mm = mm;
+  page_dir_activate(cur);
+  intr_set_status(old_status);
+}
+
+/* 释放最后一个使用者已经离开的地址空间 */
+static void mm_free(struct mm_struct* mm){
+  /* 用户空间的页表只能通过递归映射访问，暂时换到mm的页表上释放 */
+  mm_switch(mm);
+  user_space_free();
+  mm_switch(NULL);
+  free_kernel_pages(mm->userprog_vaddr.vaddr_bitmap.bits, USER_VADDR_BITMAP_PAGES);
+  if(mm->uring != NULL){
+    free_kernel_pages(mm->uring, 1);        //共享页在用户空间，已随之释放
+  }
+  free_kernel_pages(mm->vdso, 1);
+  free_kernel_pages(mm->pgdir, 1);
+  free_kernel_pages(mm, 1);
+}
+
+/* 当前线程离开所属进程的地址空间，换用内核页表，返回原来的mm，不减少其使用者 */
+struct mm_struct* mm_leave(void){
+  struct mm_struct* mm = running_thread()->mm;
+  ASSERT(mm != NULL);
+  mm_switch(NULL);
+  return mm;
+}
+
+/* 当前线程离开所属进程的地址空间并减少一个使用者，最后一个使用者释放它。
+ * 只剩SQPOLL的poller时它不会再有提交项，让它结束并代它减去使用者 */
+void mm_exit(void){
+  struct task_struct* cur = running_thread();
+  /* 线程的用户栈随线程释放，不必等到整个地址空间释放 */
+  if(cur->ustack != NULL){
+    free_user_stack(cur->ustack, USER_THREAD_STACK_PAGES);
+    cur->ustack = NULL;
+  }
+  struct mm_struct* mm = mm_leave();
+  struct uring_ctx* ctx = mm->uring;            //mm在减少使用者之后可能已被释放
+  uint32_t users = atomic_xadd(&mm->users, (uint32_t)-1);
+  if(users == 2 && ctx != NULL && ctx->poller != NULL){
+    uring_poller_stop(ctx);
+    users = atomic_xadd(&mm->users, (uint32_t)-1);
+  }
+  if(users == 1){
+    mm_free(mm);
+  }
+}
+
+/* 系统调用uthread_exit，结束当前用户线程，不再返回。
+ * 进程的最后一个线程结束时释放进程的地址空间 */
+void sys_uthread_exit(int32_t status){
+  mm_exit();
+  thread_exit(status);
 }
 
 /* 创建用户进程 */
 void process_execute(void* filename, char* name){
   /* pcb内核的数据结构，由内核来维护进程信息，因此要在内核内存池中申请 */
-  struct task_struct* thread = get_kernel_pages(1);             //获取PCB空间
+  struct task_struct* thread = pcb_alloc();                     //获取PCB空间
+  if(thread == NULL){
+    return;
+  }
   init_thread(thread, name, default_prio);                      //初始化我们创造的PCB空间
-  create_user_vaddr_bitmap(thread);                             //构建位图，并且写入咱们的PCB
+  if(thread->pid < 0){                                          //pid已用完
+    pcb_free(thread);
+    return;
+  }
   thread_create(thread, start_process, filename);               //这里预留出中断栈和线程栈，然后将还原后的eip指针指向start_process(filename);
-  thread->pgdir = create_page_dir();                            //新建用户页目录并且返回页目录首地址
-  block_desc_init(thread->u_block_desc);
+  thread->mm = mm_create(thread->pid);                          //新建地址空间，进程号就是第一个线程的pid
+  thread_detach(thread);                                        //用户线程没有人join，结束后自动回收
+
+  thread_enqueue_new(thread);
+}
+
+/* 系统调用uthread_create，在当前进程中创建执行function(arg)的用户线程，
+ * 新线程与创建者共享地址空间，有自己的用户栈，function返回时结束线程。
+ * tls非0时作为新线程局部存储的基址，用户态通过gs访问，
+ * 约定TLS块的第一个字存放其自身地址，以便用movl %gs:0取得。
+ * 成功返回新线程的pid，失败返回-1 */
+int32_t sys_uthread_create(void* function, void* arg, void* tls){
+  struct task_struct* cur = running_thread();
+  if(cur->mm == NULL || function == NULL){
+    return -1;
+  }
+  struct task_struct* thread = pcb_alloc();
+  if(thread == NULL){
+    return -1;
+  }
+  init_thread(thread, cur->name, cur->base_priority);
+  if(thread->pid < 0){
+    pcb_free(thread);
+    return -1;
+  }
+  /* 用户栈从进程的虚拟地址池中分配，下有保护页，栈顶放参数arg和返回地址uthread_return */
+  void* ustack = get_user_stack(USER_THREAD_STACK_PAGES);
+  if(ustack == NULL){
+    pid_free(thread);
+    pcb_free(thread);
+    return -1;
+  }
+  uint32_t* esp = (uint32_t*)((uint32_t)ustack + (USER_THREAD_STACK_PAGES + 1) * PG_SIZE);
+  *--esp = (uint32_t)arg;
+  *--esp = (uint32_t)uthread_return;
+
+  thread_create(thread, start_uthread, NULL);
+  user_intr_stack_init(user_intr_stack(thread), function, esp);
+  mm_get(cur->mm);
+  thread->mm = cur->mm;
+  thread->tls_base = (uint32_t)tls;
+  thread->ustack = ustack;
+  thread_detach(thread);
+
+  thread_enqueue_new(thread);
+  return thread->pid;
+}
+
+/* 创建执行function(func_arg)的内核线程，它与当前进程共享地址空间，
+ * 可以直接访问进程的用户内存，用户态的malloc等也作用于该进程。
+ * 线程退出前先用mm_leave离开地址空间，它不会自动回收，join它的线程负责减去它在mm中的使用者。
+ * 成功返回其PCB，失败返回NULL */
+struct task_struct* process_kthread_start(char* name, int prio, thread_func function, void* func_arg){
+  struct task_struct* cur = running_thread();
+  ASSERT(cur->mm != NULL);
+  struct task_struct* thread = pcb_alloc();
+  if(thread == NULL){
+    return NULL;
+  }
+  init_thread(thread, name, prio);
+  if(thread->pid < 0){
+    pcb_free(thread);
+    return NULL;
+  }
+  thread_create(thread, function, func_arg);
+  mm_get(cur->mm);
+  thread->mm = cur->mm;
 
+  thread_enqueue_new(thread);
+  return thread;
+}
+
+/* 系统调用set_tls，把当前线程局部存储的基址设为base，返回用户态后即通过gs生效 */
+int32_t sys_set_tls(void* base){
+  struct task_struct* cur = running_thread();
+  if(cur->mm == NULL){
+    return -1;
+  }
   enum intr_status old_status = intr_disable();
-  ASSERT(!elem_find(&thread_ready_list, &thread->general_tag));
-  list_append(&thread_ready_list, &thread->general_tag);
-  ASSERT(!elem_find(&thread_all_list, &thread->all_list_tag));
-  list_append(&thread_all_list, &thread->all_list_tag);
+  cur->tls_base = (uint32_t)base;
+  tls_activate(cur);
   intr_set_status(old_status);
+  return 0;
 }
\ No newline at end of file
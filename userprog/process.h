@@ -4,11 +4,18 @@
 #include "stdint.h"
 #define USER_STACK3_VADDR (0xc0000000 - 0x1000)
 #define USER_VADDR_START 0x8048000
+#define USER_THREAD_STACK_PAGES 1  //用户线程的栈，与进程主线程的用户栈一样大
 #define default_prio   31
 void start_process(void* filename);
 void page_dir_activate(struct task_struct* p_thread);
 void process_activate(struct task_struct* pthread);
 uint32_t* create_page_dir(void);
-void create_user_vaddr_bitmap(struct task_struct* user_prog);
+void create_user_vaddr_bitmap(struct mm_struct* mm);
 void process_execute(void* filename, char* name);
+int32_t sys_uthread_create(void* function, void* arg, void* tls);
+void sys_uthread_exit(int32_t status);
+struct mm_struct* mm_leave(void);
+void mm_exit(void);
+int32_t sys_set_tls(void* base);
+struct task_struct* process_kthread_start(char* name, int prio, thread_func function, void* func_arg);
 #endif
\ No newline at end of file
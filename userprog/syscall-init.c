@@ -5,13 +5,42 @@
 #include "console.h"
 #include "string.h"
 #include "memory.h"
+#include "futex.h"
+#include "process.h"
+#include "global.h"
+#include "tss.h"
+#include "smp.h"
+#include "uring-ctx.h"
+#include "memtrace.h"
+#include "irqtrace.h"
+#include "sched.h"
 #define syscall_nr 32
 typedef void* syscall;
 syscall syscall_table[syscall_nr];
 
-/* 返回当前任务的pid */
+#define MSR_SYSENTER_CS 0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+extern void sysenter_entry(void);
+static bool sysenter_enabled;       //CPU支持sysenter，各CPU都要设置MSR
+
+static inline void wrmsr(uint32_t msr, uint32_t val){
+  asm volatile ("wrmsr" : : "c"(msr), "a"(val), "d"(0));
+}
+
+/* 设置本CPU的sysenter入口，IA32_SYSENTER_ESP指向本CPU的tss，
+ * 入口从tss的esp0取当前线程的0级栈，线程切换时不必再改MSR */
+static void sysenter_cpu_init(uint8_t cpu){
+  wrmsr(MSR_SYSENTER_CS, SELECTOR_SYSENTER_CS);
+  wrmsr(MSR_SYSENTER_ESP, (uint32_t)tss_get(cpu));
+  wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+}
+
+/* 返回当前任务的pid，用户线程返回其所属进程的pid */
 uint32_t sys_getpid(void){
-  return running_thread()->pid;
+  struct task_struct* cur = running_thread();
+  return cur->mm != NULL ? cur->mm->pid : cur->pid;
 }
 
 /* 打印字符串（未实现文件系统版本） */
@@ -19,6 +48,14 @@ uint32_t sys_write(char* str){
   console_put_str(str);
   return strlen(str);
 }
+/* 在内核中按号调用系统调用，供提交环使用，nr须是已注册的系统调用号 */
+int32_t syscall_dispatch(uint32_t nr, uint32_t arg1, uint32_t arg2, uint32_t arg3){
+  if(nr >= syscall_nr){
+    return -1;
+  }
+  return ((int32_t (*)(uint32_t, uint32_t, uint32_t))syscall_table[nr])(arg1, arg2, arg3);
+}
+
 /* 初始化系统调用 */
 void syscall_init(void){
   put_str("syscall_init_start\n");
@@ -26,5 +63,28 @@ void syscall_init(void){
   syscall_table[SYS_WRITE] = sys_write;
   syscall_table[SYS_MALLOC] = sys_malloc;
   syscall_table[SYS_FREE] = sys_free;
+  syscall_table[SYS_MEMSTAT] = sys_memstat;
+  syscall_table[SYS_SCHEDSTAT] = sys_schedstat;
+  syscall_table[SYS_FUTEX_WAIT] = sys_futex_wait;
+  syscall_table[SYS_FUTEX_WAKE] = sys_futex_wake;
+  syscall_table[SYS_UTHREAD_CREATE] = sys_uthread_create;
+  syscall_table[SYS_SET_TLS] = sys_set_tls;
+  syscall_table[SYS_URING_SETUP] = sys_uring_setup;
+  syscall_table[SYS_URING_ENTER] = sys_uring_enter;
+  syscall_table[SYS_MEMTRACE] = sys_memtrace;
+  syscall_table[SYS_IRQTRACE] = sys_irqtrace;
+  syscall_table[SYS_SETPOLICY] = sys_setpolicy;
+  syscall_table[SYS_UTHREAD_EXIT] = sys_uthread_exit;
+  sysenter_enabled = sysenter_supported();
+  if(sysenter_enabled){
+    sysenter_cpu_init(0);
+  }
   put_str("syscall_init done\n");
+}
+
+/* AP启动时调用，在syscall_init之后 */
+void syscall_ap_init(void){
+  if(sysenter_enabled){
+    sysenter_cpu_init(cpu_id());
+  }
 }
\ No newline at end of file
@@ -3,5 +3,7 @@
 #include "stdint.h"
 uint32_t sys_getpid(void);
 uint32_t sys_write(char* str);
+int32_t syscall_dispatch(uint32_t nr, uint32_t arg1, uint32_t arg2, uint32_t arg3);
 void syscall_init(void);
+void syscall_ap_init(void);
 #endif
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "global.h"
 #include "string.h"
 #include "print.h"
+#include "smp.h"
 /* 任务状态段tss结构 */
 struct tss{
   uint32_t backlink;
@@ -33,11 +34,34 @@ struct tss{
   uint32_t trace;
   uint32_t io_base;
 };
-static struct tss tss;
+/* 每个CPU一个tss，各自记录本CPU上用户进程的0级栈 */
+static struct tss tss[MAX_CPUS];
 
-/* 更新tss中esp0字段的值为pthread的0级栈 */
+#define GDT_BASE 0xc0000900
+/* BSP的tss在第4项，5、6项为用户段，7~10项为sysenter/sysexit用的段，
+ * AP的tss从第11项起依次存放，之后是每个CPU一个的TLS段，
+ * loader.S中gdt之后的0xb00处存放着内存容量，所以最多64项 */
+#define SYSENTER_GDT_INDEX 7
+#define GDT_DESC_CNT (11 + MAX_CPUS - 1 + MAX_CPUS)
+
+/* 更新pthread所在CPU的tss中esp0字段的值为pthread的0级栈 */
 void update_tss_esp(struct task_struct* pthread){
-  tss.esp0 = (uint32_t*)((uint32_t)pthread + PG_SIZE);
+  tss[pthread->cpu].esp0 = (uint32_t*)((uint32_t)pthread + PG_SIZE);
+}
+
+/* cpu的tss描述符在gdt中的下标 */
+static uint32_t tss_gdt_index(uint8_t cpu){
+  return cpu == 0 ? 4 : 10 + cpu;
+}
+
+/* cpu的TLS描述符在gdt中的下标 */
+static uint32_t tls_gdt_index(uint8_t cpu){
+  return 10 + MAX_CPUS + cpu;
+}
+
+/* cpu的tss地址，sysenter从中取当前线程的0级栈 */
+void* tss_get(uint8_t cpu){
+  return &tss[cpu];
 }
 
 /* 创建gdt描述符 */
@@ -53,22 +77,51 @@ static struct gdt_desc make_gdt_desc(uint32_t* desc_addr, uint32_t limit, uint8_
   return desc;
 }
 
-/* 在gdt中创建tss并重新加载gdt */
+/* 让用户线程pthread返回用户态时gs指向它的线程局部存储，在它被调度上CPU时调用，须关中断。
+ * gdt为所有CPU共用，每个CPU有自己的TLS描述符，把本CPU的描述符基址设为tls_base，
+ * 并改写pthread内核栈顶中断栈中保存的gs，线程换到别的CPU上运行时会在那里重新设置 */
+void tls_activate(struct task_struct* pthread){
+  struct intr_stack* proc_stack = (struct intr_stack*)((uint32_t)pthread + PG_SIZE - sizeof(struct intr_stack));
+  if(pthread->tls_base == 0){
+    proc_stack->gs = 0;
+    return;
+  }
+  uint32_t idx = tls_gdt_index(pthread->cpu);
+  *((struct gdt_desc*)GDT_BASE + idx) = \
+      make_gdt_desc((uint32_t*)pthread->tls_base, 0xfffff, GDT_DATA_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
+  proc_stack->gs = (idx << 3) + (TI_GDT << 2) + RPL3;
+}
+
+/* 本CPU加载gdt，并以cpu号对应的tss作为任务寄存器 */
+void tss_load(uint8_t cpu){
+  /* gdt中16位的limit 32位的段基址 */
+  uint64_t gdt_operand = ((8 * GDT_DESC_CNT - 1) | ((uint64_t)(uint32_t)GDT_BASE << 16));
+  asm volatile ("lgdt %0" : : "m"(gdt_operand));
+  asm volatile ("ltr %w0" : : "r"((uint16_t)((tss_gdt_index(cpu) << 3) + (TI_GDT << 2) + RPL0)));
+}
+
+/* 在gdt中为每个CPU创建tss并由BSP重新加载gdt，AP启动时再各自调用tss_load */
 void tss_init(){
   put_str("tss_init start\n");
-  uint32_t tss_size = sizeof(tss);
-  memset(&tss, 0, tss_size);
-  tss.ss0 = SELECTOR_K_STACK;
-  tss.io_base = tss_size;       //io位图的偏移地址大于或等于TSS大小，这样设置表示没有IO位图
-  /* gdt段基址是0x900,我们将tss放到第4个位置，也就是0x900 + 0x20 */
-  /* 在gdt当中添加dpl为0的TSS描述符 */
-  *((struct gdt_desc*)0xc0000920) = make_gdt_desc((uint32_t*)&tss, tss_size - 1, TSS_ATTR_LOW, TSS_ATTR_HIGH);
+  uint32_t tss_size = sizeof(struct tss);
+  uint8_t cpu;
+  for(cpu = 0; cpu < MAX_CPUS; cpu++){
+    memset(&tss[cpu], 0, tss_size);
+    tss[cpu].ss0 = SELECTOR_K_STACK;
+    tss[cpu].io_base = tss_size;    //io位图的偏移地址大于或等于TSS大小，这样设置表示没有IO位图
+    /* 在gdt当中添加dpl为0的TSS描述符，gdt段基址是0x900，BSP的tss在第4个位置，也就是0x900 + 0x20 */
+    *((struct gdt_desc*)GDT_BASE + tss_gdt_index(cpu)) = \
+        make_gdt_desc((uint32_t*)&tss[cpu], tss_size - 1, TSS_ATTR_LOW, TSS_ATTR_HIGH);
+  }
   /* 在gdt当中添加dpl为3的代码段和数据段描述符 */
   *((struct gdt_desc*)0xc0000928) = make_gdt_desc((uint32_t*)0, 0xfffff, GDT_CODE_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
   *((struct gdt_desc*)0xc0000930) = make_gdt_desc((uint32_t*)0, 0xfffff, GDT_DATA_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
-  /* gdt中16位的limit 32位的段基址 */
-  uint64_t gdt_operand = ((8*7-1) | ((uint64_t)(uint32_t)0xc0000900 << 16));    //7个描述符大小
-  asm volatile ("lgdt %0" : : "m"(gdt_operand));
-  asm volatile ("ltr %w0" : : "r"(SELECTOR_TSS));
+  /* sysenter/sysexit要求的相邻四项，与上面的段一样都是平坦模型 */
+  struct gdt_desc* sysenter_desc = (struct gdt_desc*)GDT_BASE + SYSENTER_GDT_INDEX;
+  sysenter_desc[0] = make_gdt_desc((uint32_t*)0, 0xfffff, GDT_CODE_ATTR_LOW_DPL0, GDT_ATTR_HIGH);
+  sysenter_desc[1] = make_gdt_desc((uint32_t*)0, 0xfffff, GDT_DATA_ATTR_LOW_DPL0, GDT_ATTR_HIGH);
+  sysenter_desc[2] = make_gdt_desc((uint32_t*)0, 0xfffff, GDT_CODE_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
+  sysenter_desc[3] = make_gdt_desc((uint32_t*)0, 0xfffff, GDT_DATA_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
+  tss_load(0);
   put_str("tss_init and ltr done\n");
 }
\ No newline at end of file
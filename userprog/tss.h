@@ -4,7 +4,10 @@
 #include "thread.h"
 
 void update_tss_esp(struct task_struct* pthread);
+void tls_activate(struct task_struct* pthread);
 void tss_init(void);
+void tss_load(uint8_t cpu);
+void* tss_get(uint8_t cpu);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include "uring-ctx.h"
+#include "stdint.h"
+#include "global.h"
+#include "thread.h"
+#include "memory.h"
+#include "sync.h"
+#include "spinlock.h"
+#include "syscall.h"
+#include "syscall-init.h"
+#include "process.h"
+#include "timer.h"
+#include "ide.h"
+#include "fs.h"
+
+/* 判断分区是否未挂载，供list_traversal回调 */
+static bool part_unmounted(struct list_elem* pelem, int arg UNUSED){
+  return elem2entry(struct partition, part_tag, pelem) != cur_part;
+}
+
+/* 原始读写所用的暂存分区，即分区队列中第一个未挂载的分区，没有时返回NULL。
+ * 挂载的分区的超级块、位图和inode在内存中另有缓存，绕过文件系统写入会使二者不一致 */
+static struct partition* uring_scratch_part(void){
+  read_lock(&partition_lock);
+  struct list_elem* pelem = list_traversal(&partition_list, part_unmounted, 0);
+  read_unlock(&partition_lock);
+  return pelem == NULL ? NULL : elem2entry(struct partition, part_tag, pelem);
+}
+
+/* 读写暂存分区中从lba起的sec_cnt个扇区，没有暂存分区、越界或缓冲区不全在用户空间时返回-1 */
+static int32_t uring_disk_rw(bool write, uint32_t lba, void* buf, uint32_t sec_cnt){
+  struct partition* part = uring_scratch_part();
+  if(part == NULL || sec_cnt == 0 || lba >= part->sec_cnt || sec_cnt > part->sec_cnt - lba){
+    return -1;
+  }
+  if((uint32_t)buf >= 0xc0000000 || 0xc0000000 - (uint32_t)buf < sec_cnt * SECTOR_SIZE){
+    return -1;
+  }
+  if(write){
+    ide_write(part->my_disk, part->start_lba + lba, buf, sec_cnt);
+  }else{
+    ide_read(part->my_disk, part->start_lba + lba, buf, sec_cnt);
+  }
+  return 0;
+}
+
+/* 执行一个提交项，返回放入完成项的结果 */
+static int32_t uring_execute(struct uring_sqe* sqe){
+  uint32_t* args = sqe->args;
+  if(sqe->opcode < SYS_URING_SETUP){
+    return syscall_dispatch(sqe->opcode, args[0], args[1], args[2]);
+  }
+  switch(sqe->opcode){
+    case URING_OP_DISK_READ:
+      return uring_disk_rw(false, args[0], (void*)args[1], args[2]);
+    case URING_OP_DISK_WRITE:
+      return uring_disk_rw(true, args[0], (void*)args[1], args[2]);
+    default:
+      return -1;
+  }
+}
+
+/* 依次执行SQ中至多max个提交项，每项的结果放入CQ，CQ满时提前停止，返回执行的个数。
+ * 共享页中的值都可能被用户随时改写，提交项先拷贝出来再执行 */
+static uint32_t uring_submit_sqes(struct uring_ctx* ctx, uint32_t max){
+  struct uring* ring = ctx->ring;
+  uint32_t done = 0;
+  lock_acquire(&ctx->sq_lock);
+  while(done < max){
+    uint32_t head = ring->sq_head;
+    uint32_t cq_tail = ring->cq_tail;
+    if(head == ring->sq_tail || cq_tail - ring->cq_head >= URING_CQ_ENTRIES){
+      break;
+    }
+    uring_barrier();            //看到sq_tail之后再读提交项
+    struct uring_sqe sqe = ring->sqes[head & URING_SQ_MASK];
+    uring_barrier();
+    ring->sq_head = head + 1;   //已拷出，用户可以复用这一项
+
+    struct uring_cqe* cqe = &ring->cqes[cq_tail & URING_CQ_MASK];
+    cqe->user_data = sqe.user_data;
+    cqe->res = uring_execute(&sqe);
+    uring_barrier();            //完成项的内容要先于cq_tail写入
+    ring->cq_tail = cq_tail + 1;
+    done++;
+  }
+  lock_release(&ctx->sq_lock);
+  return done;
+}
+
+/* SQPOLL模式的poller，轮询SQ并唤醒等待完成项的线程，
+ * 连续URING_POLL_IDLE_TICKS没有取到提交项就置URING_NEED_WAKEUP睡眠，等uring_enter唤醒。
+ * 进程的用户线程都退出后由uring_poller_stop叫停 */
+static void uring_poller(void* arg){
+  struct uring_ctx* ctx = arg;
+  struct uring* ring = ctx->ring;
+  uint32_t idle_since = ticks;
+  while(!ctx->stop){
+    if(uring_submit_sqes(ctx, URING_SQ_ENTRIES) > 0){
+      lock_acquire(&ctx->cq_lock);
+      cond_broadcast(&ctx->cq_cond);
+      lock_release(&ctx->cq_lock);
+      idle_since = ticks;
+      continue;
+    }
+    if(ticks - idle_since >= URING_POLL_IDLE_TICKS){
+      /* 先置标志再检查SQ，xchg兼作全屏障：用户在此之前的提交会被这次检查看到，
+       * 之后的提交用户会看到标志而来唤醒；CQ满时SQ不为空，继续轮询等用户取走完成项 */
+      atomic_xchg(&ring->flags, URING_NEED_WAKEUP);
+      if(ring->sq_head == ring->sq_tail){
+        sema_down(&ctx->poller_wake);
+      }
+      atomic_xchg(&ring->flags, 0);
+      idle_since = ticks;
+    }
+    thread_yield();
+  }
+  /* ctx和mm由join本线程的uring_poller_stop的调用者释放 */
+  mm_leave();
+  thread_exit(0);
+}
+
+/* 系统调用uring_setup，为当前进程创建提交/完成环，返回共享页在用户空间的地址，
+ * 每个进程只能创建一个，失败返回NULL。
+ * 以URING_SETUP_SQPOLL创建但poller线程创建失败时退化为普通模式，用户据ring->setup_flags判断 */
+struct uring* sys_uring_setup(uint32_t flags){
+  struct mm_struct* mm = running_thread()->mm;
+  if(mm == NULL || mm->uring != NULL || (flags & ~URING_SETUP_SQPOLL) != 0){
+    return NULL;
+  }
+  /* 共享页在进程的用户地址空间中，用户直接访问，内核在本进程的线程中访问；
+   * 内核状态由内核维护，不能放在用户可写的内存中 */
+  struct uring* ring = get_user_pages(1);
+  if(ring == NULL){
+    return NULL;
+  }
+  struct uring_ctx* ctx = get_kernel_pages(1);
+  if(ctx == NULL){
+    mfree_page(PF_USER, ring, 1);
+    return NULL;
+  }
+  ctx->ring = ring;
+  lock_init(&ctx->sq_lock);
+  lock_init(&ctx->cq_lock);
+  cond_init(&ctx->cq_cond);
+  sema_init(&ctx->poller_wake, 0);
+  ctx->poller = NULL;
+  ctx->stop = false;
+
+  /* 同一进程的几个线程可能同时创建，只有一个能成功 */
+  if(atomic_cmpxchg((volatile uint32_t*)&mm->uring, 0, (uint32_t)ctx) != 0){
+    free_kernel_pages(ctx, 1);
+    mfree_page(PF_USER, ring, 1);
+    return NULL;
+  }
+  if(flags & URING_SETUP_SQPOLL){
+    ctx->poller = process_kthread_start("uring_poller", URING_POLLER_PRIO, uring_poller, ctx);
+    if(ctx->poller != NULL){
+      ring->setup_flags = URING_SETUP_SQPOLL;
+    }
+  }
+  return ring;
+}
+
+/* 系统调用uring_enter，普通模式下执行SQ中至多to_submit个提交项，返回执行的个数；
+ * SQPOLL模式下由poller执行，flags为URING_ENTER_WAKEUP时唤醒poller，
+ * 为URING_ENTER_GETEVENTS时等到CQ中至少有min_complete个完成项，返回0。
+ * 当前进程没有创建环时返回-1 */
+int32_t sys_uring_enter(uint32_t to_submit, uint32_t min_complete, uint32_t flags){
+  struct mm_struct* mm = running_thread()->mm;
+  if(mm == NULL || mm->uring == NULL){
+    return -1;
+  }
+  struct uring_ctx* ctx = mm->uring;
+  if(ctx->poller == NULL){
+    return uring_submit_sqes(ctx, to_submit);
+  }
+  if(flags & URING_ENTER_WAKEUP){
+    sema_up(&ctx->poller_wake);
+  }
+  if(flags & URING_ENTER_GETEVENTS){
+    struct uring* ring = ctx->ring;
+    lock_acquire(&ctx->cq_lock);
+    while(ring->cq_tail - ring->cq_head < min_complete){
+      cond_wait(&ctx->cq_cond, &ctx->cq_lock);
+    }
+    lock_release(&ctx->cq_lock);
+  }
+  return 0;
+}
+
+/* 叫停ctx的poller并等它结束，由进程最后一个退出的用户线程调用，此时mm只剩poller一个使用者 */
+void uring_poller_stop(struct uring_ctx* ctx){
+  struct task_struct* poller = ctx->poller;
+  ctx->stop = true;
+  sema_up(&ctx->poller_wake);   //poller可能正在睡眠
+  thread_join(poller);
+}
@@ -0,0 +1,24 @@
+#ifndef __USERPROG_URING_CTX_H
+#define __USERPROG_URING_CTX_H
+#include "stdint.h"
+#include "sync.h"
+#include "uring.h"
+
+#define URING_POLL_IDLE_TICKS 10    //poller连续这么久没有取到提交项就睡眠
+#define URING_POLLER_PRIO 31
+
+/* 提交/完成环在内核中的状态，每个进程至多一个，挂在mm_struct上，随地址空间释放 */
+struct uring_ctx{
+  struct uring* ring;           //共享页，位于进程的用户地址空间
+  struct lock sq_lock;          //uring_enter的各线程和poller互斥地消费SQ、生产CQ
+  struct lock cq_lock;          //与cq_cond配合，等待完成项
+  struct condition cq_cond;
+  struct semaphore poller_wake; //poller睡眠时在此等待
+  struct task_struct* poller;   //SQPOLL模式的poller线程，否则为NULL
+  volatile bool stop;           //进程的用户线程都已退出，poller应当结束
+};
+
+struct uring* sys_uring_setup(uint32_t flags);
+int32_t sys_uring_enter(uint32_t to_submit, uint32_t min_complete, uint32_t flags);
+void uring_poller_stop(struct uring_ctx* ctx);
+#endif
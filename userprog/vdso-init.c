@@ -0,0 +1,88 @@
+#include "vdso-init.h"
+#include "stdint.h"
+#include "global.h"
+#include "thread.h"
+#include "memory.h"
+#include "interrupt.h"
+#include "timer.h"
+#include "print.h"
+#include "spinlock.h"
+
+#define CPUID_TSC (1 << 4)
+#define vdso_barrier() asm volatile ("" : : : "memory")
+
+static struct vdso_data* vdata;     //全体进程共享的数据页，在内核中可写
+
+/* 用PIT的ticks校准TSC，返回每个tick的TSC周期数，没有TSC或频率过低时返回0 */
+static uint32_t tsc_calibrate(void){
+  uint32_t eax = 1, ebx, ecx = 0, edx;
+  asm volatile ("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+  if(!(edx & CPUID_TSC)){
+    return 0;
+  }
+  volatile uint32_t* now = &ticks;
+  enum intr_status old_status = intr_enable();
+  uint32_t start = *now;
+  while(*now == start){         //先对齐到tick的边界
+    cpu_relax();
+  }
+  start = *now;
+  uint32_t tsc_start = vdso_rdtsc();
+  while(*now - start < VDSO_CALIBRATE_TICKS){
+    cpu_relax();
+  }
+  uint32_t tsc_per_tick = (vdso_rdtsc() - tsc_start) / VDSO_CALIBRATE_TICKS;
+  intr_set_status(old_status);
+  /* 用户态按TSC折算微秒时要求商不超过32位 */
+  return tsc_per_tick < vdata->us_per_tick ? 0 : tsc_per_tick;
+}
+
+/* 初始化共享数据页，须在timer_init之后、第一次开中断之前调用，
+ * 此时还没有TSC的频率，时钟只精确到tick，由vdso_calibrate补上 */
+void vdso_init(void){
+  put_str("vdso_init start\n");
+  vdata = get_kernel_pages(1);
+  vdata->seq = 0;
+  vdata->hz = TIMER_HZ;
+  vdata->us_per_tick = 1000000 / TIMER_HZ;
+  vdata->tsc_per_tick = 0;
+  vdso_update();
+  put_str("vdso_init done\n");
+}
+
+/* 校准TSC并填入共享数据页，校准时要开中断数个tick，
+ * 须在所有已解除屏蔽的中断都注册了处理程序（keyboard_init）之后调用 */
+void vdso_calibrate(void){
+  uint32_t tsc_per_tick = tsc_calibrate();
+  enum intr_status old_status = intr_disable();
+  vdata->seq++;
+  vdso_barrier();
+  vdata->tsc_per_tick = tsc_per_tick;
+  vdso_barrier();
+  vdata->seq++;
+  intr_set_status(old_status);
+}
+
+/* ticks改变后由BSP在关中断时调用，只有这一个写者 */
+void vdso_update(void){
+  vdata->seq++;
+  vdso_barrier();               //x86上写写不会乱序，只需防止编译器重排
+  vdata->ticks = ticks;
+  vdata->tsc_low = vdso_rdtsc();
+  vdso_barrier();
+  vdata->seq++;
+}
+
+/* 为新进程创建只读的常量页，由mm_create调用 */
+struct vdso_proc* vdso_proc_create(int16_t pid){
+  struct vdso_proc* vproc = get_kernel_pages(1);
+  vproc->pid = pid;
+  vproc->start_ticks = ticks;
+  return vproc;
+}
+
+/* 把共享数据页和mm的常量页映射到进程的用户空间，在进程自己的主线程中调用 */
+void vdso_map(struct mm_struct* mm){
+  user_map_ro(VDSO_VADDR, addr_v2p((uint32_t)vdata));
+  user_map_ro(VDSO_PROC_VADDR, addr_v2p((uint32_t)mm->vdso));
+}
@@ -0,0 +1,14 @@
+#ifndef __USERPROG_VDSO_INIT_H
+#define __USERPROG_VDSO_INIT_H
+#include "stdint.h"
+#include "vdso.h"
+
+#define VDSO_CALIBRATE_TICKS 5      //用这么多个tick校准TSC的频率
+
+struct mm_struct;
+void vdso_init(void);
+void vdso_calibrate(void);
+void vdso_update(void);
+struct vdso_proc* vdso_proc_create(int16_t pid);
+void vdso_map(struct mm_struct* mm);
+#endif